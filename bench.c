@@ -0,0 +1,757 @@
+// Usage: bench [--json] [--shape NAME] [--size SIZE]
+//   --json    print one JSON object per line instead of a table
+//   --shape   only run the corpus of this shape
+//   --size    corpus size in bytes, with an optional K, M or G suffix
+// Without --shape or --size, the parsing modes are compared afterwards as well
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define SMH_PARSER_COUNT_ALLOCATIONS
+#define SMH_PARSER_IMPLEMENTATION
+#include "smh.h"
+
+struct bench_allocations {
+    size_t allocations;
+    size_t reallocations;
+    size_t frees;
+    size_t bytes;
+    size_t peak;
+};
+
+static struct smh_allocations bench_counted;
+
+// Adds what was counted to 'totals', keeping the highest peak
+void bench_add(struct bench_allocations *totals, const struct smh_allocations *counted){
+    totals->allocations += counted->allocations;
+    totals->reallocations += counted->reallocations;
+    totals->frees += counted->frees;
+    totals->bytes += counted->bytes;
+    if(counted->peak > totals->peak) totals->peak = counted->peak;
+}
+
+// Counts the allocations made on this thread until bench_collect
+void bench_reset(){
+    memset(&bench_counted, 0, sizeof bench_counted);
+    smh_count_allocations(&bench_counted);
+}
+
+void bench_collect(struct bench_allocations *totals){
+    smh_count_allocations(NULL);
+    bench_add(totals, &bench_counted);
+}
+
+bool bench_json_output;
+
+struct bench_measurement {
+    const char *name;
+
+    // Bytes processed per iteration, or zero when throughput doesn't apply
+    size_t bytes;
+
+    // Nodes in the document, or zero when time per node doesn't apply
+    size_t nodes;
+
+    size_t iterations;
+    double elapsed;
+    struct bench_allocations allocations;
+};
+
+void bench_report(const struct bench_measurement *measurement){
+    double per_iteration = measurement->elapsed / measurement->iterations;
+    double mb_per_second = measurement->bytes ? measurement->bytes / per_iteration / 1e6 : 0;
+    double ns_per_node = measurement->nodes ? per_iteration * 1e9 / measurement->nodes : 0;
+    size_t iterations = measurement->iterations;
+
+    // Maximum resident set size so far, in kilobytes on Linux and bytes on macOS
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    if(bench_json_output){
+        printf("{\"benchmark\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.1f, \"mb_per_s\": %.1f, \"ns_per_node\": %.2f, "
+            "\"allocations\": %zu, \"reallocations\": %zu, \"frees\": %zu, \"allocated_bytes\": %zu, \"peak_heap_bytes\": %zu, \"peak_rss\": %ld}\n",
+            measurement->name, iterations, per_iteration * 1e9, mb_per_second, ns_per_node,
+            measurement->allocations.allocations / iterations, measurement->allocations.reallocations / iterations,
+            measurement->allocations.frees / iterations, measurement->allocations.bytes / iterations,
+            measurement->allocations.peak, (long) usage.ru_maxrss);
+    } else {
+        printf("%-36s %10.1f %12.1f %9.2f %10zu %12zu %10ld\n", measurement->name, mb_per_second, per_iteration * 1e9, ns_per_node,
+            (measurement->allocations.allocations + measurement->allocations.reallocations) / iterations,
+            measurement->allocations.peak, (long) usage.ru_maxrss);
+    }
+
+    fflush(stdout);
+}
+
+struct bench_buffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+void bench_append(struct bench_buffer *buffer, const char *text, size_t length){
+    if(buffer->length + length + 1 > buffer->capacity){
+        while(buffer->length + length + 1 > buffer->capacity){
+            buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        }
+
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+
+    memcpy(&buffer->data[buffer->length], text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+void bench_append_cstr(struct bench_buffer *buffer, const char *text){
+    bench_append(buffer, text, strlen(text));
+}
+
+void bench_append_indentation(struct bench_buffer *buffer, size_t level){
+    for(size_t i = 0; i < level; i++){
+        bench_append_cstr(buffer, "  ");
+    }
+}
+
+unsigned int bench_random(unsigned long long *state){
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned int) (*state >> 33);
+}
+
+void bench_append_words(struct bench_buffer *buffer, unsigned long long *state, size_t length){
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+
+    for(size_t i = 0; i < length; i++){
+        char character = (i % 8 == 7) ? ' ' : letters[bench_random(state) % 26];
+        bench_append(buffer, &character, 1);
+    }
+}
+
+// Bullet array of records whose values are each 'value_length' bytes long
+char *bench_generate_long_values(size_t records, size_t value_length, size_t *out_length){
+    struct bench_buffer buffer = {0};
+    unsigned long long state = 1;
+
+    for(size_t i = 0; i < records; i++){
+        bench_append_cstr(&buffer, "- name: ");
+        bench_append_words(&buffer, &state, value_length);
+        bench_append_cstr(&buffer, "\n  description: ");
+        bench_append_words(&buffer, &state, value_length);
+        bench_append_cstr(&buffer, "\n  quoted: \"");
+        bench_append_words(&buffer, &state, value_length);
+        bench_append_cstr(&buffer, "\"\n");
+    }
+
+    *out_length = buffer.length;
+    return buffer.data;
+}
+
+// One map with a key for every line
+void bench_append_wide(struct bench_buffer *buffer, unsigned long long *state, size_t index){
+    char key[32];
+    sprintf(key, "field_%zu: ", index);
+    bench_append_cstr(buffer, key);
+    bench_append_words(buffer, state, 12);
+    bench_append_cstr(buffer, "\n");
+}
+
+// Bullet items nesting maps and bullets 32 levels deep
+void bench_append_deep(struct bench_buffer *buffer, unsigned long long *state, size_t index){
+    (void) index;
+
+    for(size_t level = 0; level < 32; level++){
+        char key[32];
+        sprintf(key, "- level_%zu:\n", level);
+        bench_append_indentation(buffer, level);
+        bench_append_cstr(buffer, key);
+    }
+
+    bench_append_indentation(buffer, 32);
+    bench_append_cstr(buffer, "- leaf: ");
+    bench_append_words(buffer, state, 8);
+    bench_append_cstr(buffer, "\n");
+}
+
+// Records with a long unquoted and a long quoted value
+void bench_append_long_string(struct bench_buffer *buffer, unsigned long long *state, size_t index){
+    (void) index;
+
+    bench_append_cstr(buffer, "- text: ");
+    bench_append_words(buffer, state, 4096);
+    bench_append_cstr(buffer, "\n  quoted: \"");
+    bench_append_words(buffer, state, 4096);
+    bench_append_cstr(buffer, "\"\n");
+}
+
+// Quoted strings where every few characters are an escape
+void bench_append_escapes(struct bench_buffer *buffer, unsigned long long *state, size_t index){
+    static const char *escapes[] = {"\\n", "\\\"", "\\\\"};
+    (void) index;
+
+    bench_append_cstr(buffer, "- \"");
+
+    for(size_t i = 0; i < 32; i++){
+        bench_append_words(buffer, state, 1 + bench_random(state) % 6);
+        bench_append_cstr(buffer, escapes[bench_random(state) % 3]);
+    }
+
+    bench_append_cstr(buffer, "\"\n");
+}
+
+void bench_append_bracket_array(struct bench_buffer *buffer, unsigned long long *state, size_t depth){
+    size_t length = 1 + bench_random(state) % 4;
+
+    bench_append_cstr(buffer, "[");
+
+    for(size_t i = 0; i < length; i++){
+        if(i) bench_append_cstr(buffer, ", ");
+
+        if(depth < 4 && bench_random(state) % 3 == 0){
+            bench_append_bracket_array(buffer, state, depth + 1);
+        } else {
+            bench_append_words(buffer, state, 1 + bench_random(state) % 7);
+        }
+    }
+
+    bench_append_cstr(buffer, "]");
+}
+
+// Bullet items that are nested bracket arrays
+void bench_append_brackets(struct bench_buffer *buffer, unsigned long long *state, size_t index){
+    (void) index;
+
+    bench_append_cstr(buffer, "- ");
+    bench_append_bracket_array(buffer, state, 0);
+    bench_append_cstr(buffer, "\n");
+}
+
+// Records shaped like the ones in example.c
+void bench_append_records(struct bench_buffer *buffer, unsigned long long *state, size_t index){
+    char line[128];
+
+    bench_append_cstr(buffer, "- name: ");
+    bench_append_words(buffer, state, 7);
+    bench_append_cstr(buffer, "\n  age: ");
+    sprintf(line, "%u\n  phone number: (%03u) %03u-%03u\n  email: user%zu@email.com\n",
+        bench_random(state) % 100, bench_random(state) % 1000, bench_random(state) % 1000, bench_random(state) % 1000, index);
+    bench_append_cstr(buffer, line);
+}
+
+struct bench_shape {
+    const char *name;
+    void (*append)(struct bench_buffer *buffer, unsigned long long *state, size_t index);
+};
+
+static const struct bench_shape bench_shapes[] = {
+    {"wide", bench_append_wide},
+    {"deep", bench_append_deep},
+    {"long-string", bench_append_long_string},
+    {"escape-heavy", bench_append_escapes},
+    {"bracket-heavy", bench_append_brackets},
+    {"records", bench_append_records},
+};
+
+// Appends whole entries of the shape until the corpus is at least 'size' bytes, the same ones every time
+char *bench_generate(const struct bench_shape *shape, size_t size, size_t *out_length){
+    struct bench_buffer buffer = {0};
+    unsigned long long state = 1;
+
+    for(size_t i = 0; buffer.length < size; i++){
+        shape->append(&buffer, &state, i);
+    }
+
+    *out_length = buffer.length;
+    return buffer.data;
+}
+
+size_t bench_count_nodes(const struct smh_dict *dict){
+    size_t count = 1;
+
+    switch(dict->kind){
+    case SMH_DICT_ARRAY:
+        for(size_t i = 0; i < dict->as_array.length; i++){
+            count += bench_count_nodes(&dict->as_array.items[i]);
+        }
+        break;
+    case SMH_DICT_OBJECT:
+        for(size_t i = 0; i < dict->as_object.length; i++){
+            count += bench_count_nodes(&dict->as_object.values[i]);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return count;
+}
+
+double bench_now(){
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Parsing, freeing and converting to JSON, each timed and counted on its own
+void bench_corpus(const char *name, const char *markup, size_t length){
+    struct bench_measurement parse = { .name = "parse", .bytes = length };
+    struct bench_measurement release = { .name = "free", .bytes = length };
+    struct bench_measurement json = { .name = "json" };
+    char parse_name[96], free_name[96], json_name[96];
+
+    do {
+        bench_reset();
+        double start = bench_now();
+        struct smh_result result = smh_parse_n(markup, length);
+        double end = bench_now();
+
+        if(!result.ok){
+            printf("%s: parse error - %s\n", name, smh_failure_str(&result.as_failure));
+            exit(1);
+        }
+
+        bench_collect(&parse.allocations);
+        parse.elapsed += end - start;
+        parse.iterations++;
+
+        if(parse.nodes == 0) parse.nodes = bench_count_nodes(&result.as_success);
+
+        if(json.elapsed < 0.5){
+            bench_reset();
+            start = bench_now();
+            char *text = smh_dict_json(&result.as_success);
+            end = bench_now();
+
+            bench_collect(&json.allocations);
+            json.bytes = strlen(text);
+            json.elapsed += end - start;
+            json.iterations++;
+            smh_free(text);
+        }
+
+        bench_reset();
+        start = bench_now();
+        smh_result_free(&result);
+        end = bench_now();
+
+        bench_collect(&release.allocations);
+        release.elapsed += end - start;
+        release.iterations++;
+    } while(parse.elapsed + release.elapsed < 0.5 || json.elapsed < 0.5);
+
+    release.nodes = json.nodes = parse.nodes;
+
+    sprintf(parse_name, "%s/parse", name);
+    sprintf(free_name, "%s/free", name);
+    sprintf(json_name, "%s/json", name);
+    parse.name = parse_name;
+    release.name = free_name;
+    json.name = json_name;
+
+    bench_report(&parse);
+    bench_report(&release);
+    bench_report(&json);
+}
+
+// Counting through the options includes allocations made on other threads
+void bench_parse(const char *name, const char *markup, size_t length, const struct smh_options *options){
+    struct bench_measurement measurement = { .name = name, .bytes = length };
+    struct smh_allocations parsing;
+    struct smh_options counted = *options;
+    counted.allocations = &parsing;
+
+    double start = bench_now();
+
+    do {
+        struct smh_result result = smh_parse_n_ex(markup, length, &counted);
+
+        if(!result.ok){
+            printf("%s: parse error - %s\n", name, smh_failure_str(&result.as_failure));
+            exit(1);
+        }
+
+        bench_add(&measurement.allocations, &parsing);
+        smh_result_free(&result);
+        measurement.iterations++;
+        measurement.elapsed = bench_now() - start;
+    } while(measurement.elapsed < 0.5);
+
+    bench_report(&measurement);
+}
+
+void bench_validate(const char *name, const char *markup, size_t length){
+    struct bench_measurement measurement = { .name = name, .bytes = length };
+    bench_reset();
+    double start = bench_now();
+
+    do {
+        enum smh_errorcode errorcode = smh_validate(markup, length);
+
+        if(errorcode){
+            struct smh_failure failure = { errorcode };
+            printf("%s: validation error - %s\n", name, smh_failure_str(&failure));
+            exit(1);
+        }
+
+        measurement.iterations++;
+        measurement.elapsed = bench_now() - start;
+    } while(measurement.elapsed < 0.5);
+
+    bench_collect(&measurement.allocations);
+    bench_report(&measurement);
+}
+
+struct bench_record {
+    char *name;
+    char *description;
+    char *quoted;
+};
+
+struct bench_records {
+    struct bench_record *items;
+    size_t length;
+};
+
+const struct smh_field bench_record_fields[] = {
+    { .name = "name", .offset = offsetof(struct bench_record, name), .type = SMH_FIELD_STRING },
+    { .name = "description", .offset = offsetof(struct bench_record, description), .type = SMH_FIELD_STRING },
+    { .name = "quoted", .offset = offsetof(struct bench_record, quoted), .type = SMH_FIELD_STRING },
+};
+
+const struct smh_schema bench_record_schema = { bench_record_fields, 3 };
+const struct smh_field bench_record_element = { .type = SMH_FIELD_OBJECT, .schema = &bench_record_schema };
+
+const struct smh_field bench_records_fields[] = {
+    {
+        .name = "records", .offset = offsetof(struct bench_records, items), .type = SMH_FIELD_ARRAY,
+        .element = &bench_record_element, .element_size = sizeof(struct bench_record), .count_offset = offsetof(struct bench_records, length),
+    },
+};
+
+const struct smh_schema bench_records_schema = { bench_records_fields, 1 };
+
+// Decoding records straight into structs, with the bullet array moved under a key since only maps decode
+void bench_decode(const char *name, const char *markup, size_t length){
+    struct bench_buffer buffer = {0};
+    bench_append_cstr(&buffer, "records:\n  ");
+
+    for(size_t i = 0; i < length; i++){
+        bench_append(&buffer, &markup[i], 1);
+        if(markup[i] == '\n' && i + 1 < length) bench_append_cstr(&buffer, "  ");
+    }
+
+    struct bench_measurement measurement = { .name = name, .bytes = buffer.length };
+    bench_reset();
+    double start = bench_now();
+
+    do {
+        struct bench_records records = {0};
+
+        if(smh_decode(buffer.data, buffer.length, &bench_records_schema, &records, NULL)){
+            printf("%s: decode error\n", name);
+            exit(1);
+        }
+
+        smh_schema_free(&bench_records_schema, &records);
+        measurement.iterations++;
+        measurement.elapsed = bench_now() - start;
+    } while(measurement.elapsed < 0.5);
+
+    bench_collect(&measurement.allocations);
+    bench_report(&measurement);
+    free(buffer.data);
+}
+
+// Pulling a numeric column out of records, by hand with strtoll and with smh_array_ints
+void bench_columns(void){
+    struct bench_buffer buffer = {0};
+    size_t records = 1000000;
+
+    for(size_t i = 0; i < records; i++){
+        char record[64];
+        sprintf(record, "- id: %zu\n  score: %zu\n", i, i * 7919 % 100003);
+        bench_append_cstr(&buffer, record);
+    }
+
+    struct smh_result result = smh_parse_n_ex(buffer.data, buffer.length, &(struct smh_options){ .borrow_strings = true });
+    if(!result.ok) exit(1);
+
+    struct smh_array *array = &result.as_success.as_array;
+    int64_t *scores = malloc(sizeof *scores * array->length);
+    struct smh_key score = smh_key("score", 5);
+    char digits[32];
+
+    for(int mode = 0; mode < 2; mode++){
+        struct bench_measurement measurement = { .name = mode ? "columns/smh_array_ints" : "columns/strtoll", .nodes = records };
+        bench_reset();
+        double start = bench_now();
+
+        do {
+            if(mode){
+                if(smh_array_ints(array, &score, scores) != array->length) exit(1);
+            } else {
+                // Borrowed strings aren't null-terminated
+                for(size_t i = 0; i < array->length; i++){
+                    struct smh_string *value = &smh_object_get_key(&array->items[i].as_object, &score)->as_string;
+                    memcpy(digits, value->cstr, value->length);
+                    digits[value->length] = '\0';
+                    scores[i] = strtoll(digits, NULL, 10);
+                }
+            }
+
+            measurement.iterations++;
+            measurement.elapsed = bench_now() - start;
+        } while(measurement.elapsed < 0.5);
+
+        bench_collect(&measurement.allocations);
+        bench_report(&measurement);
+    }
+
+    free(scores);
+    free(buffer.data);
+    smh_result_free(&result);
+}
+
+void bench_json(const char *name, const char *markup, size_t length, enum smh_json_format format){
+    struct smh_result result = smh_parse_n_ex(markup, length, &(struct smh_options){ .borrow_strings = true });
+    struct smh_buffer buffer = {0};
+    struct bench_measurement measurement = { .name = name };
+    bench_reset();
+    double start = bench_now();
+
+    do {
+        buffer.length = 0;
+        smh_dict_json_append(&buffer, &result.as_success, format);
+        measurement.iterations++;
+        measurement.elapsed = bench_now() - start;
+    } while(measurement.elapsed < 0.5);
+
+    bench_collect(&measurement.allocations);
+    measurement.bytes = buffer.length;
+    bench_report(&measurement);
+    smh_free(buffer.data);
+    smh_result_free(&result);
+}
+
+void bench_emit(const char *name, const char *markup, size_t length){
+    struct smh_result result = smh_parse_n_ex(markup, length, &(struct smh_options){ .borrow_strings = true });
+    struct smh_buffer buffer = {0};
+    struct bench_measurement measurement = { .name = name };
+    bench_reset();
+    double start = bench_now();
+
+    do {
+        buffer.length = 0;
+        smh_dict_smh_append(&buffer, &result.as_success);
+        measurement.iterations++;
+        measurement.elapsed = bench_now() - start;
+    } while(measurement.elapsed < 0.5);
+
+    bench_collect(&measurement.allocations);
+    measurement.bytes = buffer.length;
+    bench_report(&measurement);
+    smh_free(buffer.data);
+    smh_result_free(&result);
+}
+
+// Opening a snapshot of the document, against the markup it was made from
+void bench_snapshot(const char *name, const char *markup, size_t length){
+    struct smh_tape tape;
+    size_t snapshot_length;
+
+    if(smh_tape_parse(&tape, markup, length)) exit(1);
+    void *snapshot = smh_snapshot_create(&tape, &snapshot_length);
+    smh_tape_free(&tape);
+
+    struct bench_measurement measurement = { .name = name, .bytes = length };
+    bench_reset();
+    double start = bench_now();
+
+    do {
+        if(smh_snapshot_open(&tape, snapshot, snapshot_length)){
+            printf("%s: snapshot error\n", name);
+            exit(1);
+        }
+
+        measurement.iterations++;
+        measurement.elapsed = bench_now() - start;
+    } while(measurement.elapsed < 0.5);
+
+    bench_collect(&measurement.allocations);
+    bench_report(&measurement);
+    smh_free(snapshot);
+}
+
+// Typing and deleting a character in a value in the middle of the document
+void bench_edit(const char *name, const char *markup, size_t length){
+    struct smh_document *document = smh_document_create(markup, length);
+    size_t offset = strstr(&markup[length / 2], "name: ") - markup + 6;
+    struct bench_measurement measurement = { .name = name };
+    bench_reset();
+    double start = bench_now();
+
+    do {
+        bool removing = measurement.iterations % 2;
+
+        if(smh_document_edit(document, offset, removing, "x", !removing)){
+            printf("%s: edit error\n", name);
+            exit(1);
+        }
+
+        measurement.iterations++;
+        measurement.elapsed = bench_now() - start;
+    } while(measurement.elapsed < 0.5);
+
+    bench_collect(&measurement.allocations);
+    bench_report(&measurement);
+    smh_document_free(document);
+}
+
+// Parsing options and the other ways of reading and writing documents, on records of varying value lengths
+void bench_modes(){
+    size_t value_lengths[] = {16, 256, 4096};
+
+    for(size_t i = 0; i < sizeof value_lengths / sizeof *value_lengths; i++){
+        size_t length;
+        char *markup = bench_generate_long_values(8 * 1024 * 1024 / (value_lengths[i] * 3), value_lengths[i], &length);
+        char name[64];
+
+        sprintf(name, "long-values/%zu", value_lengths[i]);
+        bench_parse(name, markup, length, &(struct smh_options){0});
+
+        sprintf(name, "long-values/%zu/borrowed", value_lengths[i]);
+        bench_parse(name, markup, length, &(struct smh_options){ .borrow_strings = true });
+
+        struct smh_symbols *symbols = smh_symbols_create();
+        sprintf(name, "long-values/%zu/interned", value_lengths[i]);
+        bench_parse(name, markup, length, &(struct smh_options){ .symbols = symbols });
+        smh_symbols_free(symbols);
+
+        sprintf(name, "long-values/%zu/validate", value_lengths[i]);
+        bench_validate(name, markup, length);
+
+        sprintf(name, "long-values/%zu/decode", value_lengths[i]);
+        bench_decode(name, markup, length);
+
+        sprintf(name, "long-values/%zu/snapshot", value_lengths[i]);
+        bench_snapshot(name, markup, length);
+
+        sprintf(name, "long-values/%zu/edit", value_lengths[i]);
+        bench_edit(name, markup, length);
+
+        sprintf(name, "long-values/%zu/json", value_lengths[i]);
+        bench_json(name, markup, length, SMH_JSON_COMPACT);
+
+        sprintf(name, "long-values/%zu/json-pretty", value_lengths[i]);
+        bench_json(name, markup, length, SMH_JSON_PRETTY);
+
+        sprintf(name, "long-values/%zu/emit", value_lengths[i]);
+        bench_emit(name, markup, length);
+
+        free(markup);
+    }
+
+    bench_columns();
+
+    #ifdef SMH_PARSER_THREADS
+        size_t length;
+        char *markup = bench_generate_long_values(64 * 1024 * 1024 / (64 * 3), 64, &length);
+
+        for(unsigned int threads = 1; threads <= 16; threads *= 2){
+            char name[64];
+            sprintf(name, "long-values/64/threads-%u", threads);
+            bench_parse(name, markup, length, &(struct smh_options){ .borrow_strings = true, .threads = threads });
+        }
+
+        free(markup);
+    #endif
+}
+
+// Reads sizes like 64K, 8M or 1G
+size_t bench_parse_size(const char *text){
+    char *end;
+    size_t size = strtoull(text, &end, 10);
+
+    switch(*end){
+    case 'G': case 'g':
+        size *= 1024;
+        // fallthrough
+    case 'M': case 'm':
+        size *= 1024;
+        // fallthrough
+    case 'K': case 'k':
+        size *= 1024;
+        break;
+    }
+
+    return size;
+}
+
+void bench_format_size(char *out, size_t size){
+    const char *suffixes = "KMG";
+    size_t suffix = 0;
+
+    size /= 1024;
+
+    while(suffix < 2 && size >= 1024 && size % 1024 == 0){
+        size /= 1024;
+        suffix++;
+    }
+
+    sprintf(out, "%zu%c", size, suffixes[suffix]);
+}
+
+int main(int argc, char **argv){
+    const char *only_shape = NULL;
+    size_t sizes[] = {64 * 1024, 8 * 1024 * 1024};
+    size_t sizes_length = sizeof sizes / sizeof *sizes;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--json") == 0){
+            bench_json_output = true;
+        } else if(strcmp(argv[i], "--shape") == 0 && i + 1 < argc){
+            only_shape = argv[++i];
+        } else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc){
+            sizes[0] = bench_parse_size(argv[++i]);
+            sizes_length = 1;
+        } else {
+            fprintf(stderr, "usage: %s [--json] [--shape NAME] [--size SIZE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(!bench_json_output){
+        #if defined(SMH_PARSER_USE_AVX2)
+            printf("scanning kernel: %s\n", __builtin_cpu_supports("avx2") ? "avx2" : "sse2");
+        #elif defined(SMH_PARSER_USE_SSE2)
+            printf("scanning kernel: sse2\n");
+        #else
+            printf("scanning kernel: scalar\n");
+        #endif
+
+        printf("%-36s %10s %12s %9s %10s %12s %10s\n", "benchmark", "MB/s", "ns/op", "ns/node", "allocs/op", "peak heap", "peak rss");
+    }
+
+    for(size_t i = 0; i < sizeof bench_shapes / sizeof *bench_shapes; i++){
+        if(only_shape && strcmp(only_shape, bench_shapes[i].name) != 0) continue;
+
+        for(size_t j = 0; j < sizes_length; j++){
+            size_t length;
+            char *markup = bench_generate(&bench_shapes[i], sizes[j], &length);
+            char name[64];
+
+            sprintf(name, "%s/", bench_shapes[i].name);
+            bench_format_size(&name[strlen(name)], sizes[j]);
+            bench_corpus(name, markup, length);
+            free(markup);
+        }
+    }
+
+    if(only_shape == NULL && sizes_length == sizeof sizes / sizeof *sizes){
+        bench_modes();
+    }
+
+    return 0;
+}
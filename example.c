@@ -39,6 +39,10 @@ int main(){
 
     struct smh_dict dictionary = result.as_success;
     traverse_dictionary(&dictionary, 0);
+
+    printf("\nWritten back out as SMH:\n\n");
+    smh_dict_smh_file(&dictionary, stdout);
+
     smh_result_free(&result);
 }
 
@@ -47,7 +51,7 @@ void traverse_dictionary(struct smh_dict *dict, size_t level){
     case SMH_DICT_STRING: {
             char *string = smh_string_json(&dict->as_string);
             printf("%s\n", string);
-            free(string);
+            smh_free(string);
         }
         break;
     case SMH_DICT_ARRAY: {
@@ -71,7 +75,7 @@ void traverse_dictionary(struct smh_dict *dict, size_t level){
                     print_indentation(level);
                 }
 
-                printf("%s: ", object->keys[i].cstr);
+                printf("%.*s: ", (int) object->keys[i].length, object->keys[i].cstr);
 
                 if(object->values[i].kind != SMH_DICT_STRING){
                     putchar('\n');
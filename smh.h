@@ -11,6 +11,56 @@
     To not include additional helpers:
 
         #define SMH_PARSER_NO_HELPERS
+
+    To change the default block size of arenas:
+
+        #define SMH_ARENA_DEFAULT_BLOCK_SIZE 65536
+
+    To read files into memory instead of memory-mapping them:
+
+        #define SMH_PARSER_NO_MMAP
+
+    To only use the portable scalar scanning kernel:
+
+        #define SMH_PARSER_NO_SIMD
+
+    To change how many keys an object needs before it gets a hash index:
+
+        #define SMH_OBJECT_INDEX_THRESHOLD 16
+
+    To allow parsing on multiple threads with pthreads (see smh_options.threads):
+
+        #define SMH_PARSER_THREADS
+
+    To change the least amount of markup worth handing to another thread:
+
+        #define SMH_PARSER_THREAD_MIN_LENGTH 1048576
+
+    To change how deeply containers may be nested by default:
+
+        #define SMH_PARSER_MAX_DEPTH 1024
+
+    To keep a process-wide cache of parsed documents, which uses pthreads:
+
+        #define SMH_PARSER_CACHE
+
+    To change how many bytes of parsed documents the cache holds by default:
+
+        #define SMH_PARSER_CACHE_LIMIT 67108864
+
+    To allocate memory with something other than malloc, realloc and free (all three together):
+
+        #define SMH_MALLOC(size) my_malloc(size)
+        #define SMH_REALLOC(memory, size) my_realloc(memory, size)
+        #define SMH_FREE(memory) my_free(memory)
+
+    To count allocations (see smh_options.allocations and smh_count_allocations):
+
+        #define SMH_PARSER_COUNT_ALLOCATIONS
+
+    To collect statistics about each parse and call tracing hooks (see smh_options.stats):
+
+        #define SMH_PARSER_STATS
 */
 
 #ifndef _ISAAC_SMH_PARSER_H
@@ -19,6 +69,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 enum smh_dict_kind {
     SMH_DICT_STRING,
@@ -31,10 +82,26 @@ enum smh_errorcode {
     SMH_ERRORCODE_UNTERMINATED,
     SMH_ERRORCODE_UNABLE_TO_PARSE,
     SMH_ERRORCODE_TAB_NOT_ALLOWED,
+    SMH_ERRORCODE_UNABLE_TO_OPEN,
+    SMH_ERRORCODE_ABORTED,
+    SMH_ERRORCODE_TOO_DEEP,
+    SMH_ERRORCODE_BAD_SNAPSHOT,
+    SMH_ERRORCODE_MISSING_FIELD,
+    SMH_ERRORCODE_BAD_VALUE,
+};
+
+enum smh_string_storage {
+    SMH_STRING_OWNED,
+    SMH_STRING_BORROWED,
+    SMH_STRING_INTERNED,
 };
 
 struct smh_string {
+    // Borrowed strings point into the markup and are not null-terminated,
+    // interned strings point into a symbol table and belong to it
     char *cstr;
+    size_t length;
+    enum smh_string_storage storage;
 };
 
 struct smh_array {
@@ -42,18 +109,53 @@ struct smh_array {
     size_t length;
 };
 
+struct smh_object_index;
+
 struct smh_object {
     struct smh_string *keys;
     struct smh_dict *values;
     size_t length;
+
+    // Hash index over the keys of wide objects, otherwise NULL
+    struct smh_object_index *index;
+};
+
+enum smh_scalar_kind {
+    SMH_SCALAR_NONE,
+    SMH_SCALAR_INT,
+    SMH_SCALAR_FLOAT,
+    SMH_SCALAR_BOOL,
+    SMH_SCALAR_DURATION,
+    SMH_SCALAR_SIZE,
+};
+
+union smh_scalar {
+    int64_t as_int;
+    double as_float;
+    bool as_bool;
+    double as_duration; // Seconds
+    uint64_t as_size;   // Bytes
+};
+
+// Strings keep a cached scalar after them, in space that objects take anyway
+struct smh_cached_string {
+    struct smh_string string;
+    union smh_scalar value;
 };
 
 struct smh_dict {
     enum smh_dict_kind kind;
+
+    // Kind of the value in 'as_cached', which smh_dict_scalar fills in and every typed reader trusts.
+    // Dicts made by hand must start out with SMH_SCALAR_NONE, and it must be set back to that
+    // whenever the string of a dict changes, or a copied dict is given a different string
+    enum smh_scalar_kind cached;
+
     union {
         struct smh_string as_string;
         struct smh_array as_array;
         struct smh_object as_object;
+        struct smh_cached_string as_cached;
     };
 };
 
@@ -67,13 +169,449 @@ struct smh_result {
         struct smh_failure as_failure;
         struct smh_dict as_success;
     };
+
+    // Set when the document lives inside of an arena,
+    // in which case smh_result_free does nothing
+    struct smh_arena *arena;
+};
+
+struct smh_arena_block;
+
+struct smh_arena {
+    struct smh_arena_block *first;
+    struct smh_arena_block *current;
+    size_t block_size;
+};
+
+// What parsing went through, for finding out why a document is slow
+struct smh_stats {
+    // Bytes of markup passed over, counting again those read after backtracking
+    size_t bytes_scanned;
+
+    // Nodes in the document, indexed by enum smh_dict_kind
+    size_t nodes[SMH_DICT_OBJECT + 1];
+
+    size_t max_depth;
+
+    // Bytes copied out of the markup for strings and keys
+    size_t bytes_copied;
+
+    // Times the parser looked ahead to the next line, only to go back to where it was
+    size_t rewinds;
+};
+
+// Called around each parse, 'stats' is only valid during the call
+struct smh_trace {
+    void *user;
+    void (*begin)(void *user, const char *data, size_t length);
+    void (*end)(void *user, enum smh_errorcode errorcode, const struct smh_stats *stats);
+};
+
+struct smh_options {
+    // Allocate the document inside of this arena instead of on the heap
+    struct smh_arena *arena;
+
+    // Have strings point into the markup instead of copying them when possible,
+    // the markup must then outlive the document
+    bool borrow_strings;
+
+    // Intern keys into this symbol table instead of copying them, the table must then outlive
+    // the document. Documents parsed with a symbol table aren't split between threads
+    struct smh_symbols *symbols;
+
+    // Also intern string values up to this many bytes long, when parsing with a symbol table
+    size_t intern_values;
+
+    // Split documents whose top level is a bullet array or map between up to this many threads,
+    // only used when compiled with SMH_PARSER_THREADS
+    unsigned int threads;
+
+    // Fail with SMH_ERRORCODE_TOO_DEEP when containers are nested deeper than this,
+    // zero means SMH_PARSER_MAX_DEPTH
+    size_t max_depth;
+
+    // Filled in with the allocations made while parsing, including those on other threads,
+    // only used when compiled with SMH_PARSER_COUNT_ALLOCATIONS
+    struct smh_allocations *allocations;
+
+    // Filled in with statistics about the parse, and hooks called before and after it,
+    // only used when compiled with SMH_PARSER_STATS
+    struct smh_stats *stats;
+    const struct smh_trace *trace;
 };
 
 struct smh_result smh_parse(const char *markup);
+struct smh_result smh_parse_arena(const char *markup, struct smh_arena *arena);
+struct smh_result smh_parse_ex(const char *markup, const struct smh_options *options);
+
+// Parses exactly 'length' bytes of 'data', which doesn't need to be null-terminated
+struct smh_result smh_parse_n(const char *data, size_t length);
+struct smh_result smh_parse_n_ex(const char *data, size_t length, const struct smh_options *options);
+
+// Read-only view of a file's contents, memory-mapped where supported
+// and read into memory for anything that can't be mapped, like pipes
+struct smh_file {
+    const char *data;
+    size_t length;
+    bool mapped;
+};
+
+bool smh_file_open(struct smh_file *file, const char *path);
+void smh_file_free(struct smh_file *file);
+
+// Parses a file directly from its mapping. On success, 'file' must be kept open for
+// as long as the document borrows from it, and freed with smh_file_free afterwards
+struct smh_result smh_parse_file(const char *path, struct smh_file *file);
+struct smh_result smh_parse_file_ex(const char *path, struct smh_file *file, const struct smh_options *options);
+
+// Receives a document as a stream of events instead of a tree.
+// Callbacks may be left NULL, and return false to stop parsing early
+struct smh_handler {
+    void *user;
+    bool (*begin_array)(void *user);
+    bool (*end_array)(void *user);
+    bool (*begin_object)(void *user);
+    bool (*key)(void *user, const char *data, size_t length);
+    bool (*string)(void *user, const char *data, size_t length);
+    bool (*end_object)(void *user);
+};
+
+// Parses without building a document, memory use doesn't depend on the size of the markup.
+// Strings passed to callbacks are not null-terminated and are only valid during the callback
+enum smh_errorcode smh_parse_events(const char *data, size_t length, const struct smh_handler *handler);
+
+// Checks whether markup is well-formed without building anything, memory is
+// only allocated for documents nested more than 32 levels deep
+enum smh_errorcode smh_validate(const char *data, size_t length);
+
+// Schemas describe C structs so that maps can be decoded straight into them during parsing,
+// without building a document. Each field names a key and where and how its value is stored
+enum smh_field_type {
+    SMH_FIELD_STRING, // char *, freed by smh_schema_free
+    SMH_FIELD_BOOL,   // bool, from true, false, yes or no
+    SMH_FIELD_INT,    // int
+    SMH_FIELD_INT64,  // int64_t
+    SMH_FIELD_SIZE,   // size_t
+    SMH_FIELD_DOUBLE, // double
+    SMH_FIELD_OBJECT, // Struct described by 'schema', stored in place
+    SMH_FIELD_ARRAY,  // Pointer to elements described by 'element', with their number as a size_t at 'count_offset'
+};
+
+struct smh_schema;
+
+struct smh_field {
+    const char *name;
+    size_t offset;
+    enum smh_field_type type;
+    bool required;
+
+    // Only used for objects
+    const struct smh_schema *schema;
+
+    // Only used for arrays, the offset of 'element' is from the start of each element
+    const struct smh_field *element;
+    size_t element_size;
+    size_t count_offset;
+};
+
+struct smh_schema {
+    const struct smh_field *fields;
+    size_t length;
+};
+
+// Decodes a map into 'target', skipping keys without a field. Fields missing from the markup are
+// left as they were, so defaults can be set beforehand, except that string and array fields must
+// start out NULL. Fails with SMH_ERRORCODE_MISSING_FIELD when a required field is missing and
+// SMH_ERRORCODE_BAD_VALUE when a value doesn't fit its field, setting 'field' to the name of the
+// field when given (NULL for the document itself). Everything decoded is freed again on failure
+enum smh_errorcode smh_decode(const char *data, size_t length, const struct smh_schema *schema, void *target, const char **field);
+
+// Frees the strings and arrays of a decoded struct, setting them back to NULL
+void smh_schema_free(const struct smh_schema *schema, void *target);
+
+// Push parsers take a document in pieces as it arrives and hand over each entry of its top-level
+// bullet array or map as soon as it's complete, so only unfinished entries are kept in memory.
+// Other documents are handed over at once when finished. Keys are NULL for array items,
+// and items are only valid during the callback, which returns false to stop parsing
+struct smh_push_parser;
+
+struct smh_push_parser *smh_push_parser_create(bool (*item)(void *user, const struct smh_string *key, struct smh_dict *value), void *user);
+enum smh_errorcode smh_push_parser_feed(struct smh_push_parser *parser, const char *chunk, size_t length);
+
+// Parses whatever remains, afterwards the parser can be fed the next document
+enum smh_errorcode smh_push_parser_finish(struct smh_push_parser *parser);
+void smh_push_parser_free(struct smh_push_parser *parser);
+
+// Documents keep their markup so that after an edit, only the top-level bullet items or
+// map entries around it are parsed again and spliced into the tree. Markup that can't be
+// split into entries is parsed whole. Creating a document never fails, errors are reported
+// by smh_document_error while the tree stays as it was for the last valid markup
+struct smh_document;
+
+struct smh_document *smh_document_create(const char *data, size_t length);
+void smh_document_free(struct smh_document *document);
+
+// Replaces 'removed' bytes at 'offset' with 'text', returning the error of the new markup if any
+enum smh_errorcode smh_document_edit(struct smh_document *document, size_t offset, size_t removed, const char *text, size_t length);
+enum smh_errorcode smh_document_error(const struct smh_document *document);
+
+const struct smh_dict *smh_document_dict(const struct smh_document *document);
+const char *smh_document_markup(struct smh_document *document, size_t *length);
+
+#define SMH_TAPE_NONE SIZE_MAX
+
+// Tapes store a whole document as one contiguous array of nodes in document order,
+// so that the first child of a container is the node right after it
+struct smh_tape_node {
+    enum smh_dict_kind kind;
+
+    // Containing node, or SMH_TAPE_NONE for the root
+    size_t parent;
+
+    // One past the last node of this subtree, which is where the next sibling begins
+    size_t end;
+
+    // Number of children, or number of bytes for strings
+    size_t length;
+
+    // Offsets into the string pool, keys are only present on values of objects
+    size_t string;
+    size_t key;
+    size_t key_length;
+};
+
+struct smh_tape {
+    struct smh_tape_node *nodes;
+    size_t count;
+    size_t capacity;
+
+    // Every string and key, each null-terminated
+    char *strings;
+    size_t strings_length;
+    size_t strings_capacity;
+};
+
+enum smh_errorcode smh_tape_parse(struct smh_tape *tape, const char *data, size_t length);
+void smh_tape_from_dict(struct smh_tape *tape, const struct smh_dict *dict);
+void smh_tape_free(struct smh_tape *tape);
+
+// Nodes are referred to by their position in the tape, the root is always 0.
+// Navigation returns SMH_TAPE_NONE when there is no such node
+enum smh_dict_kind smh_tape_kind(const struct smh_tape *tape, size_t node);
+size_t smh_tape_length(const struct smh_tape *tape, size_t node);
+const char *smh_tape_string(const struct smh_tape *tape, size_t node);
+const char *smh_tape_key(const struct smh_tape *tape, size_t node, size_t *length);
+size_t smh_tape_parent(const struct smh_tape *tape, size_t node);
+size_t smh_tape_child(const struct smh_tape *tape, size_t node);
+size_t smh_tape_next(const struct smh_tape *tape, size_t node);
+size_t smh_tape_subtree_size(const struct smh_tape *tape, size_t node);
+
+// Iterates over the children of a container
+struct smh_tape_iterator {
+    const struct smh_tape *tape;
+    size_t node;
+};
+
+struct smh_tape_iterator smh_tape_iterate(const struct smh_tape *tape, size_t container);
+bool smh_tape_iterator_next(struct smh_tape_iterator *iterator, size_t *node);
+
+// Copies a subtree out into a regular document
+struct smh_result smh_tape_to_dict(const struct smh_tape *tape, size_t node);
+
+// Snapshots are tapes laid out in one block of memory that can be saved and later used
+// in place, for instance straight from a memory-mapped file, without parsing or allocating.
+// They use offsets instead of pointers, and can only be opened on machines with the same
+// byte order and word size as the one that created them. Convert to a snapshot with
+// smh_tape_parse or smh_tape_from_dict followed by smh_snapshot_create, and back with smh_tape_to_dict
+#define SMH_SNAPSHOT_VERSION 1
+
+// Returns a block of 'length' bytes to be freed by the caller
+void *smh_snapshot_create(const struct smh_tape *tape, size_t *length);
+
+// Verifies a snapshot and turns 'tape' into a read-only view of it, failing with
+// SMH_ERRORCODE_BAD_SNAPSHOT when it is damaged or was made by an incompatible machine.
+// The data must stay alive while the tape is used, calling smh_tape_free on it is optional
+enum smh_errorcode smh_snapshot_open(struct smh_tape *tape, const void *data, size_t length);
+
+// Opens a snapshot file by mapping it, 'file' must be kept open for as long as 'tape' is used
+enum smh_errorcode smh_snapshot_load(struct smh_tape *tape, const char *path, struct smh_file *file);
+
+#ifdef SMH_PARSER_CACHE
+    // Documents in the cache are shared by everyone who loads the same markup or file,
+    // and are kept alive by references. They must not be modified
+    struct smh_shared;
+
+    struct smh_cache_stats {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t entries;
+
+        // Bytes taken by cached documents, which are evicted least recently used first beyond 'limit'
+        size_t memory;
+        size_t limit;
+    };
+
+    // Return a new reference to the document, parsing it first when it isn't cached.
+    // Markup is looked up by a hash of its bytes, files by their path, size and modification time.
+    // On failure these return NULL and set 'errorcode' when given
+    struct smh_shared *smh_cache_parse(const char *data, size_t length, enum smh_errorcode *errorcode);
+    struct smh_shared *smh_cache_parse_file(const char *path, enum smh_errorcode *errorcode);
+
+    const struct smh_dict *smh_shared_dict(const struct smh_shared *shared);
+    struct smh_shared *smh_shared_retain(struct smh_shared *shared);
+    void smh_shared_release(struct smh_shared *shared);
+
+    void smh_cache_set_limit(size_t limit);
+    struct smh_cache_stats smh_cache_get_stats(void);
+
+    // Evicts every document, those still referenced are freed once released
+    void smh_cache_clear(void);
+#endif // SMH_PARSER_CACHE
+
 void smh_result_free(struct smh_result *);
 const char *smh_failure_str(struct smh_failure *);
 
+// Keys with a precomputed hash, for looking up the same field across many objects
+struct smh_key {
+    const char *data;
+    size_t length;
+    uint64_t hash;
+};
+
+struct smh_key smh_key(const char *data, size_t length);
+
+// Finds the value of the first entry with a matching key, or returns NULL
+struct smh_dict *smh_object_get(const struct smh_object *object, const char *key, size_t length);
+struct smh_dict *smh_object_get_key(const struct smh_object *object, const struct smh_key *key);
+
+// Symbol tables keep a single copy of each distinct string put into them, at the same address
+// until the table is freed, so that identical strings can be compared by their address.
+// They may be shared by any number of documents, but not between threads
+struct smh_symbols;
+
+struct smh_symbols *smh_symbols_create(void);
+void smh_symbols_free(struct smh_symbols *symbols);
+
+// Returns the table's copy of a string, adding it when it's new.
+// smh_symbols_find returns NULL instead of adding it
+const char *smh_symbol(struct smh_symbols *symbols, const char *data, size_t length);
+const char *smh_symbols_find(const struct smh_symbols *symbols, const char *data, size_t length);
+size_t smh_symbols_count(const struct smh_symbols *symbols);
+
+// Finds the value of the first entry whose key is 'symbol' by comparing addresses only, for objects
+// whose keys were interned into the same table. The symbol must come from that table, since
+// its hash is kept along with it and used to look it up in the index of wide objects
+struct smh_dict *smh_object_get_symbol(const struct smh_object *object, const char *symbol);
+
+// Typed readers of strings, which return false and leave 'value' alone for anything else.
+// Parsing doesn't depend on the locale and refuses values out of range. Integers are decimal,
+// floats may have a fraction and an exponent, booleans are true, false, yes or no.
+// Durations are numbers with units like 1.5s or 1h30m, using ns, us, ms, s, m, h and d.
+// Sizes are whole numbers of bytes like 512, 64K or 8MiB, where K, M, G and T are powers of 1024
+// in either case, and may be followed by B or iB
+bool smh_dict_int(const struct smh_dict *dict, int64_t *value);
+bool smh_dict_float(const struct smh_dict *dict, double *value);
+bool smh_dict_bool(const struct smh_dict *dict, bool *value);
+bool smh_dict_duration(const struct smh_dict *dict, double *seconds);
+bool smh_dict_size(const struct smh_dict *dict, uint64_t *bytes);
+
+// Reads like the above and caches the value in the dict, so reading it again as the same kind
+// doesn't convert it again. This modifies the dict, so it must not be used on shared documents
+bool smh_dict_scalar(struct smh_dict *dict, enum smh_scalar_kind kind, union smh_scalar *value);
+
+// Reads every item of an array, or the value of 'key' in every item when given, in one pass.
+// Returns how many were read, which is less than the length of the array when one couldn't be
+size_t smh_array_ints(const struct smh_array *array, const struct smh_key *key, int64_t *values);
+size_t smh_array_floats(const struct smh_array *array, const struct smh_key *key, double *values);
+
+// Queries are compiled once from paths like 'servers[3].limits.memory' or '[*].email',
+// where '*' matches every item of an array or value of an object.
+// Compiling returns NULL for malformed paths
+struct smh_query;
+
+struct smh_query *smh_query_compile(const char *path);
+void smh_query_free(struct smh_query *query);
+
+// Matches point into the document instead of being copies.
+// smh_query_all stores up to 'capacity' matches and returns how many there are in total
+struct smh_dict *smh_query_first(const struct smh_query *query, struct smh_dict *dict);
+size_t smh_query_all(const struct smh_query *query, struct smh_dict *dict, struct smh_dict **matches, size_t capacity);
+
+// Arenas hand out memory from large blocks that are only ever released all at once.
+// Documents parsed into an arena are freed by resetting or freeing the arena.
+void smh_arena_create(struct smh_arena *arena, size_t block_size);
+void smh_arena_reset(struct smh_arena *arena);
+void smh_arena_free(struct smh_arena *arena);
+
+// Frees memory handed over to the caller, such as strings from the helpers, buffer data and
+// snapshots. Needed instead of free when SMH_MALLOC is defined or allocations are counted
+void smh_free(void *memory);
+
+struct smh_allocations {
+    size_t allocations;
+    size_t reallocations;
+    size_t frees;
+
+    // Bytes requested by allocations, and by reallocations for what they grew by
+    size_t bytes;
+
+    // Most bytes in use at once and bytes in use now, out of those allocated while counting
+    size_t peak;
+    size_t current;
+};
+
+// Counts the allocations made on the calling thread into 'allocations' until called again with NULL,
+// only when compiled with SMH_PARSER_COUNT_ALLOCATIONS
+void smh_count_allocations(struct smh_allocations *allocations);
+
 #ifndef SMH_PARSER_NO_HELPERS
+    #include <stdio.h>
+
+    enum smh_json_format {
+        SMH_JSON_DEFAULT, // {"key": ["a", "b"]}
+        SMH_JSON_COMPACT, // {"key":["a","b"]}
+        SMH_JSON_PRETTY,  // Two-space indentation with one value per line
+    };
+
+    // Growable output buffer, data is null-terminated once written to and is freed by the caller with smh_free.
+    // Setting length back to zero reuses the memory for the next document
+    struct smh_buffer {
+        char *data;
+        size_t length;
+        size_t capacity;
+    };
+
+    // Writers receive output in pieces as it's produced, returning false stops writing
+    struct smh_writer {
+        bool (*write)(void *user, const char *data, size_t length);
+        void *user;
+    };
+
+    // Serialize in a single pass over the document without building per-value strings.
+    // Functions returning bool report whether all output was written
+    void smh_dict_json_append(struct smh_buffer *buffer, struct smh_dict *dict, enum smh_json_format format);
+    bool smh_dict_json_write(struct smh_dict *dict, enum smh_json_format format, const struct smh_writer *writer);
+    bool smh_dict_json_file(struct smh_dict *dict, enum smh_json_format format, FILE *file);
+
+    #if defined(__unix__) || defined(__APPLE__)
+        bool smh_dict_json_fd(struct smh_dict *dict, enum smh_json_format format, int fd);
+    #endif
+
+    // Emit canonical SMH: bullet arrays, maps, and quotes only where a string would otherwise
+    // be read differently. Output parses back into the same document and emits identically.
+    // Documents containing empty objects, or keys that SMH can't express, can't be emitted,
+    // which makes these return false (NULL for smh_dict_smh) and leaves the buffer as it was,
+    // though writers may already have been handed part of the document
+    bool smh_dict_smh_append(struct smh_buffer *buffer, struct smh_dict *dict);
+    bool smh_dict_smh_write(struct smh_dict *dict, const struct smh_writer *writer);
+    bool smh_dict_smh_file(struct smh_dict *dict, FILE *file);
+
+    #if defined(__unix__) || defined(__APPLE__)
+        bool smh_dict_smh_fd(struct smh_dict *dict, int fd);
+    #endif
+
+    char *smh_dict_smh(struct smh_dict *);
     char *smh_dict_json(struct smh_dict *);
     char *smh_string_json(struct smh_string *);
     char *smh_array_json(struct smh_array *);
@@ -85,10 +623,179 @@ const char *smh_failure_str(struct smh_failure *);
 
 #ifdef SMH_PARSER_IMPLEMENTATION
 
-struct smh_parser {
-    unsigned long long index;
-    const char *markup;
-    size_t length;
+#if !defined(SMH_PARSER_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+    #define SMH_PARSER_USE_MMAP
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #include <stdio.h>
+#endif
+
+#if !defined(SMH_PARSER_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+    #define SMH_PARSER_USE_SSE2
+    #define SMH_PARSER_USE_AVX2
+    #include <immintrin.h>
+#endif
+
+#if defined(SMH_PARSER_THREADS) || defined(SMH_PARSER_CACHE)
+    #include <pthread.h>
+#endif
+
+#include <limits.h>
+#include <float.h>
+
+#ifdef SMH_PARSER_CACHE
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+#ifndef SMH_PARSER_CACHE_LIMIT
+#define SMH_PARSER_CACHE_LIMIT 67108864
+#endif
+
+#ifndef SMH_PARSER_THREAD_MIN_LENGTH
+#define SMH_PARSER_THREAD_MIN_LENGTH 1048576
+#endif
+
+#ifndef SMH_ARENA_DEFAULT_BLOCK_SIZE
+#define SMH_ARENA_DEFAULT_BLOCK_SIZE 65536
+#endif
+
+#ifndef SMH_OBJECT_INDEX_THRESHOLD
+#define SMH_OBJECT_INDEX_THRESHOLD 16
+#endif
+
+#ifndef SMH_PARSER_MAX_DEPTH
+#define SMH_PARSER_MAX_DEPTH 1024
+#endif
+
+#ifndef SMH_MALLOC
+#define SMH_MALLOC(size) malloc(size)
+#define SMH_REALLOC(memory, size) realloc(memory, size)
+#define SMH_FREE(memory) free(memory)
+#endif
+
+#ifdef SMH_PARSER_COUNT_ALLOCATIONS
+    // Allocations are prefixed with their size, so that frees know how much they give back
+    #define SMH_ALLOCATION_HEADER 16
+
+    static _Thread_local struct smh_allocations *smh_allocations_target;
+
+    static void smh_allocations_track(size_t added, size_t removed){
+        struct smh_allocations *allocations = smh_allocations_target;
+
+        // Memory allocated before counting began can be freed while counting
+        allocations->current = removed > allocations->current + added ? 0 : allocations->current + added - removed;
+        if(allocations->current > allocations->peak) allocations->peak = allocations->current;
+    }
+#endif
+
+static void *smh_malloc(size_t size){
+    #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+        char *block = SMH_MALLOC(size + SMH_ALLOCATION_HEADER);
+        if(block == NULL) return NULL;
+
+        memcpy(block, &size, sizeof size);
+
+        if(smh_allocations_target){
+            smh_allocations_target->allocations++;
+            smh_allocations_target->bytes += size;
+            smh_allocations_track(size, 0);
+        }
+
+        return block + SMH_ALLOCATION_HEADER;
+    #else
+        return SMH_MALLOC(size);
+    #endif
+}
+
+static void *smh_calloc(size_t count, size_t size){
+    if(size && count > SIZE_MAX / size) return NULL;
+
+    void *memory = smh_malloc(count * size);
+    if(memory) memset(memory, 0, count * size);
+    return memory;
+}
+
+static void *smh_realloc(void *memory, size_t size){
+    #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+        if(memory == NULL) return smh_malloc(size);
+
+        char *block = (char*) memory - SMH_ALLOCATION_HEADER;
+        size_t old_size;
+        memcpy(&old_size, block, sizeof old_size);
+
+        block = SMH_REALLOC(block, size + SMH_ALLOCATION_HEADER);
+        if(block == NULL) return NULL;
+
+        memcpy(block, &size, sizeof size);
+
+        if(smh_allocations_target){
+            smh_allocations_target->reallocations++;
+            if(size > old_size) smh_allocations_target->bytes += size - old_size;
+            smh_allocations_track(size, old_size);
+        }
+
+        return block + SMH_ALLOCATION_HEADER;
+    #else
+        return SMH_REALLOC(memory, size);
+    #endif
+}
+
+void smh_free(void *memory){
+    #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+        if(memory == NULL) return;
+
+        char *block = (char*) memory - SMH_ALLOCATION_HEADER;
+        size_t size;
+        memcpy(&size, block, sizeof size);
+
+        if(smh_allocations_target){
+            smh_allocations_target->frees++;
+            smh_allocations_track(0, size);
+        }
+
+        SMH_FREE(block);
+    #else
+        SMH_FREE(memory);
+    #endif
+}
+
+void smh_count_allocations(struct smh_allocations *allocations){
+    #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+        smh_allocations_target = allocations;
+    #else
+        (void) allocations;
+    #endif
+}
+
+// Containers that can be open before the parser's stack moves to the heap
+#define SMH_PARSER_INLINE_FRAMES 32
+
+#define SMH_ARENA_ALIGNMENT sizeof(void*)
+
+struct smh_arena_block {
+    struct smh_arena_block *next;
+    size_t capacity;
+    size_t used;
+    void *data[];
+};
+
+// Offsets of every structural character in the markup, along with the
+// indentation following each newline
+struct smh_index {
+    size_t *offsets;
+    size_t count;
+    size_t capacity;
+
+    // Only newlines have indentation, so it is stored by the newline's place among them
+    uint32_t *spaces;
+    size_t lines;
+    size_t lines_capacity;
 };
 
 enum smh_parent_kind {
@@ -98,22 +805,147 @@ enum smh_parent_kind {
     SMH_PARENT_MAP
 };
 
-static struct smh_string smh_string(char *cstr){
+struct smh_parser_frame {
+    enum smh_parent_kind kind;
+    size_t level;
+};
+
+struct smh_parser {
+    unsigned long long index;
+    const char *markup;
+    size_t length;
+    struct smh_arena *arena;
+    bool borrow_strings;
+    struct smh_symbols *symbols;
+    size_t intern_values;
+    struct smh_index *structural_index;
+    size_t cursor;
+    size_t line;
+    const struct smh_handler *handler;
+    char *scratch;
+    size_t scratch_capacity;
+
+    #ifdef SMH_PARSER_STATS
+        struct smh_stats *stats;
+    #endif
+
+    // Containers that are currently open, the innermost one last
+    struct smh_parser_frame *frames;
+    size_t frames_capacity;
+    size_t depth;
+    size_t max_depth;
+    struct smh_parser_frame inline_frames[SMH_PARSER_INLINE_FRAMES];
+
+    // When parsing a region cut out of a larger document, the level of the region's
+    // top-level container (otherwise SMH_NO_REGION) and what could've continued past its end
+    size_t region_level;
+    enum smh_dict_kind region_kind;
+    unsigned int region_hazards;
+    size_t region_final_level;
+};
+
+#define SMH_NO_REGION SIZE_MAX
+
+enum smh_region_hazard {
+    // A value was about to begin when the region ended
+    SMH_REGION_OPEN_VALUE = 1,
+
+    // A nested bullet array at or below the region's level reached the end of the region
+    SMH_REGION_OPEN_BULLET = 2,
+
+    // A nested map at the region's level reached the end of the region
+    SMH_REGION_OPEN_MAP = 4,
+};
+
+static struct smh_arena_block *smh_arena_block_create(size_t capacity, struct smh_arena_block *next){
+    struct smh_arena_block *block = smh_malloc(sizeof *block + capacity);
+    block->next = next;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+static size_t smh_arena_round(size_t size){
+    return (size + SMH_ARENA_ALIGNMENT - 1) & ~(SMH_ARENA_ALIGNMENT - 1);
+}
+
+static void *smh_arena_alloc(struct smh_arena *arena, size_t size){
+    size = smh_arena_round(size);
+
+    struct smh_arena_block *block = arena->current;
+
+    if(block == NULL || block->capacity - block->used < size){
+        // Blocks after the current one are always empty, so reuse the next one if it fits
+        struct smh_arena_block *next = block ? block->next : arena->first;
+
+        if(next == NULL || next->capacity < size){
+            next = smh_arena_block_create(size > arena->block_size ? size : arena->block_size, next);
+
+            if(block){
+                block->next = next;
+            } else {
+                arena->first = next;
+            }
+        }
+
+        arena->current = block = next;
+    }
+
+    void *pointer = (char*) block->data + block->used;
+    block->used += size;
+    return pointer;
+}
+
+static void *smh_arena_realloc(struct smh_arena *arena, void *pointer, size_t old_size, size_t new_size){
+    if(pointer == NULL) return smh_arena_alloc(arena, new_size);
+
+    struct smh_arena_block *block = arena->current;
+    size_t old_rounded = smh_arena_round(old_size);
+    size_t new_rounded = smh_arena_round(new_size);
+
+    // Resize in place when this is the most recent allocation
+    if((char*) pointer + old_rounded == (char*) block->data + block->used && block->used - old_rounded + new_rounded <= block->capacity){
+        block->used = block->used - old_rounded + new_rounded;
+        return pointer;
+    }
+
+    if(new_size <= old_size) return pointer;
+
+    void *moved = smh_arena_alloc(arena, new_size);
+    memcpy(moved, pointer, old_size);
+    return moved;
+}
+
+static struct smh_string smh_string(char *cstr, size_t length){
     struct smh_string string;
     string.cstr = cstr;
+    string.length = length;
+    string.storage = SMH_STRING_OWNED;
     return string;
 }
 
-static struct smh_dict smh_dict_string(char *cstr){
+static struct smh_dict smh_dict_string(char *cstr, size_t length){
+    struct smh_dict dict;
+    dict.kind = SMH_DICT_STRING;
+    dict.cached = SMH_SCALAR_NONE;
+    dict.as_string = smh_string(cstr, length);
+    return dict;
+}
+
+static struct smh_dict smh_dict_string_view(const char *data, size_t length){
     struct smh_dict dict;
     dict.kind = SMH_DICT_STRING;
-    dict.as_string.cstr = cstr;
+    dict.cached = SMH_SCALAR_NONE;
+    dict.as_string.cstr = (char*) data;
+    dict.as_string.length = length;
+    dict.as_string.storage = SMH_STRING_BORROWED;
     return dict;
 }
 
 static struct smh_dict smh_dict_array(struct smh_dict *items, size_t length){
     struct smh_dict dict;
     dict.kind = SMH_DICT_ARRAY;
+    dict.cached = SMH_SCALAR_NONE;
     dict.as_array.items = items;
     dict.as_array.length = length;
     return dict;
@@ -122,62 +954,542 @@ static struct smh_dict smh_dict_array(struct smh_dict *items, size_t length){
 static struct smh_dict smh_dict_object(struct smh_string *keys, struct smh_dict *values, size_t length){
     struct smh_dict dict;
     dict.kind = SMH_DICT_OBJECT;
+    dict.cached = SMH_SCALAR_NONE;
     dict.as_object.keys = keys;
     dict.as_object.values = values;
     dict.as_object.length = length;
+    dict.as_object.index = NULL;
     return dict;
 }
 
-static void smh_dict_free(struct smh_dict *dict);
-static void smh_string_free(struct smh_string *string);
-static void smh_array_free(struct smh_array *array);
-static void smh_object_free(struct smh_object *object);
+// Walks a document depth-first with an explicit stack, reporting strings as
+// well as the beginning and end of every container
 
-static void smh_dict_free(struct smh_dict *dict){
-    switch(dict->kind){
-    case SMH_DICT_STRING:
-        smh_string_free(&dict->as_string);
-        break;
-    case SMH_DICT_ARRAY:
-        smh_array_free(&dict->as_array);
-        break;
-    case SMH_DICT_OBJECT:
-        smh_object_free(&dict->as_object);
-        break;
-    }
+enum smh_walk_event {
+    SMH_WALK_STRING,
+    SMH_WALK_BEGIN,
+    SMH_WALK_END,
+};
+
+struct smh_walk_step {
+    enum smh_walk_event event;
+    struct smh_dict *dict;
+
+    // Key of the dict when it's the value of an object entry, only set on SMH_WALK_STRING and SMH_WALK_BEGIN
+    struct smh_string *key;
+
+    // Position of the dict within its container
+    size_t position;
+};
+
+struct smh_walk_frame {
+    struct smh_dict *dict;
+    size_t next;
+};
+
+struct smh_walk {
+    struct smh_dict *root;
+    struct smh_walk_frame *frames;
+    size_t depth;
+    size_t capacity;
+    struct smh_walk_frame inline_frames[SMH_PARSER_INLINE_FRAMES];
+};
+
+static void smh_walk_create(struct smh_walk *walk, struct smh_dict *root){
+    walk->root = root;
+    walk->frames = walk->inline_frames;
+    walk->depth = 0;
+    walk->capacity = SMH_PARSER_INLINE_FRAMES;
 }
 
-static void smh_dicts_free(struct smh_dict *dicts, size_t length){
-    for(size_t i = 0; i < length; i++){
-        smh_dict_free(&dicts[i]);
+static void smh_walk_free(struct smh_walk *walk){
+    if(walk->frames != walk->inline_frames) smh_free(walk->frames);
+}
+
+static bool smh_walk_next(struct smh_walk *walk, struct smh_walk_step *step){
+    struct smh_dict *dict;
+
+    if(walk->root){
+        dict = walk->root;
+        walk->root = NULL;
+        step->key = NULL;
+        step->position = 0;
+    } else {
+        if(walk->depth == 0) return false;
+
+        struct smh_walk_frame *frame = &walk->frames[walk->depth - 1];
+        struct smh_dict *container = frame->dict;
+        size_t length = container->kind == SMH_DICT_ARRAY ? container->as_array.length : container->as_object.length;
+
+        if(frame->next == length){
+            walk->depth--;
+            step->event = SMH_WALK_END;
+            step->dict = container;
+            step->key = NULL;
+            step->position = 0;
+            return true;
+        }
+
+        step->position = frame->next++;
+
+        if(container->kind == SMH_DICT_ARRAY){
+            dict = &container->as_array.items[step->position];
+            step->key = NULL;
+        } else {
+            dict = &container->as_object.values[step->position];
+            step->key = &container->as_object.keys[step->position];
+        }
+    }
+
+    step->dict = dict;
+
+    if(dict->kind == SMH_DICT_STRING){
+        step->event = SMH_WALK_STRING;
+        return true;
+    }
+
+    if(walk->depth == walk->capacity){
+        walk->capacity *= 2;
+
+        if(walk->frames == walk->inline_frames){
+            walk->frames = smh_malloc(sizeof *walk->frames * walk->capacity);
+            memcpy(walk->frames, walk->inline_frames, sizeof walk->inline_frames);
+        } else {
+            walk->frames = smh_realloc(walk->frames, sizeof *walk->frames * walk->capacity);
+        }
     }
-    free(dicts);
+
+    walk->frames[walk->depth].dict = dict;
+    walk->frames[walk->depth].next = 0;
+    walk->depth++;
+
+    step->event = SMH_WALK_BEGIN;
+    return true;
 }
 
 static void smh_string_free(struct smh_string *string){
-    free(string->cstr);
+    if(string->storage == SMH_STRING_OWNED) smh_free(string->cstr);
 }
 
 static void smh_strings_free(struct smh_string *strings, size_t length){
     for(size_t i = 0; i < length; i++){
         smh_string_free(&strings[i]);
     }
+    smh_free(strings);
 }
 
-static void smh_array_free(struct smh_array *array){
-    for(size_t i = 0; i < array->length; i++){
-        smh_dict_free(&array->items[i]);
+static void smh_dict_free(struct smh_dict *dict){
+    struct smh_walk walk;
+    struct smh_walk_step step;
+
+    smh_walk_create(&walk, dict);
+
+    // Containers are freed once everything inside of them has been
+    while(smh_walk_next(&walk, &step)){
+        switch(step.event){
+        case SMH_WALK_STRING:
+            smh_string_free(&step.dict->as_string);
+            break;
+        case SMH_WALK_END:
+            if(step.dict->kind == SMH_DICT_ARRAY){
+                smh_free(step.dict->as_array.items);
+            } else {
+                smh_strings_free(step.dict->as_object.keys, step.dict->as_object.length);
+                smh_free(step.dict->as_object.values);
+                smh_free(step.dict->as_object.index);
+            }
+            break;
+        default:
+            break;
+        }
     }
-    free(array->items);
+
+    smh_walk_free(&walk);
 }
 
-static void smh_object_free(struct smh_object *object){
-    for(size_t i = 0; i < object->length; i++){
-        smh_string_free(&object->keys[i]);
-        smh_dict_free(&object->values[i]);
+static void smh_dicts_free(struct smh_dict *dicts, size_t length){
+    for(size_t i = 0; i < length; i++){
+        smh_dict_free(&dicts[i]);
     }
-    free(object->keys);
-    free(object->values);
+    smh_free(dicts);
+}
+
+// Open addressing table of entry positions plus one, so that zero marks an empty slot
+struct smh_object_index {
+    size_t mask;
+    size_t slots[];
+};
+
+struct smh_key smh_key(const char *data, size_t length){
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for(size_t i = 0; i < length; i++){
+        hash = (hash ^ (unsigned char) data[i]) * 0x100000001b3ULL;
+    }
+
+    struct smh_key key;
+    key.data = data;
+    key.length = length;
+    key.hash = hash;
+    return key;
+}
+
+static bool smh_key_matches(const struct smh_string *string, const struct smh_key *key){
+    return string->length == key->length && (string->cstr == key->data || memcmp(string->cstr, key->data, key->length) == 0);
+}
+
+static size_t smh_object_index_size(size_t length){
+    size_t capacity = 1;
+
+    while(capacity < length * 2){
+        capacity *= 2;
+    }
+
+    return sizeof(struct smh_object_index) + sizeof(size_t) * capacity;
+}
+
+// Fills an index of smh_object_index_size bytes, earlier entries win over later ones with the same key
+static struct smh_object_index *smh_object_index_fill(struct smh_object_index *index, const struct smh_object *object){
+    size_t capacity = (smh_object_index_size(object->length) - sizeof *index) / sizeof(size_t);
+    index->mask = capacity - 1;
+    memset(index->slots, 0, sizeof(size_t) * capacity);
+
+    for(size_t i = 0; i < object->length; i++){
+        struct smh_key key = smh_key(object->keys[i].cstr, object->keys[i].length);
+        size_t slot = key.hash & index->mask;
+
+        while(index->slots[slot] && !smh_key_matches(&object->keys[index->slots[slot] - 1], &key)){
+            slot = (slot + 1) & index->mask;
+        }
+
+        if(!index->slots[slot]) index->slots[slot] = i + 1;
+    }
+
+    return index;
+}
+
+struct smh_dict *smh_object_get(const struct smh_object *object, const char *key, size_t length){
+    struct smh_key hashed;
+
+    if(object->index){
+        hashed = smh_key(key, length);
+        return smh_object_get_key(object, &hashed);
+    }
+
+    // Narrow objects aren't worth hashing the key for
+    hashed.data = key;
+    hashed.length = length;
+
+    for(size_t i = 0; i < object->length; i++){
+        if(smh_key_matches(&object->keys[i], &hashed)) return &object->values[i];
+    }
+
+    return NULL;
+}
+
+struct smh_dict *smh_object_get_key(const struct smh_object *object, const struct smh_key *key){
+    struct smh_object_index *index = object->index;
+
+    if(index == NULL){
+        for(size_t i = 0; i < object->length; i++){
+            if(smh_key_matches(&object->keys[i], key)) return &object->values[i];
+        }
+
+        return NULL;
+    }
+
+    for(size_t slot = key->hash & index->mask; index->slots[slot]; slot = (slot + 1) & index->mask){
+        size_t entry = index->slots[slot] - 1;
+
+        if(smh_key_matches(&object->keys[entry], key)) return &object->values[entry];
+    }
+
+    return NULL;
+}
+
+struct smh_symbols {
+    // Open addressing table of the strings, where empty slots have no data
+    struct smh_key *slots;
+    size_t mask;
+    size_t count;
+
+    // Where the strings themselves are kept
+    struct smh_arena arena;
+};
+
+struct smh_symbols *smh_symbols_create(void){
+    struct smh_symbols *symbols = smh_malloc(sizeof *symbols);
+    symbols->slots = NULL;
+    symbols->mask = 0;
+    symbols->count = 0;
+    smh_arena_create(&symbols->arena, 0);
+    return symbols;
+}
+
+void smh_symbols_free(struct smh_symbols *symbols){
+    smh_arena_free(&symbols->arena);
+    smh_free(symbols->slots);
+    smh_free(symbols);
+}
+
+// Finds the slot holding a string, or the empty slot where it belongs
+static struct smh_key *smh_symbols_probe(const struct smh_symbols *symbols, const struct smh_key *key){
+    size_t slot = key->hash & symbols->mask;
+
+    for(;;){
+        struct smh_key *entry = &symbols->slots[slot];
+
+        if(entry->data == NULL) return entry;
+
+        if(entry->hash == key->hash && entry->length == key->length && memcmp(entry->data, key->data, key->length) == 0){
+            return entry;
+        }
+
+        slot = (slot + 1) & symbols->mask;
+    }
+}
+
+static void smh_symbols_grow(struct smh_symbols *symbols){
+    struct smh_key *old_slots = symbols->slots;
+    size_t old_capacity = old_slots ? symbols->mask + 1 : 0;
+    size_t capacity = old_capacity ? old_capacity * 2 : 64;
+
+    symbols->slots = smh_calloc(capacity, sizeof *symbols->slots);
+    symbols->mask = capacity - 1;
+
+    for(size_t i = 0; i < old_capacity; i++){
+        if(old_slots[i].data) *smh_symbols_probe(symbols, &old_slots[i]) = old_slots[i];
+    }
+
+    smh_free(old_slots);
+}
+
+const char *smh_symbol(struct smh_symbols *symbols, const char *data, size_t length){
+    // Kept at most half full
+    if(symbols->slots == NULL || (symbols->count + 1) * 2 > symbols->mask + 1){
+        smh_symbols_grow(symbols);
+    }
+
+    struct smh_key key = smh_key(data, length);
+    struct smh_key *entry = smh_symbols_probe(symbols, &key);
+
+    if(entry->data == NULL){
+        // Each string is preceded by its hash, for looking it up in object indexes
+        uint64_t *hash = smh_arena_alloc(&symbols->arena, sizeof *hash + length + 1);
+        char *copy = (char*) &hash[1];
+
+        *hash = key.hash;
+        if(length) memcpy(copy, data, length);
+        copy[length] = '\0';
+
+        entry->data = copy;
+        entry->length = length;
+        entry->hash = key.hash;
+        symbols->count++;
+    }
+
+    return entry->data;
+}
+
+const char *smh_symbols_find(const struct smh_symbols *symbols, const char *data, size_t length){
+    if(symbols->slots == NULL) return NULL;
+
+    struct smh_key key = smh_key(data, length);
+    return smh_symbols_probe(symbols, &key)->data;
+}
+
+size_t smh_symbols_count(const struct smh_symbols *symbols){
+    return symbols->count;
+}
+
+struct smh_dict *smh_object_get_symbol(const struct smh_object *object, const char *symbol){
+    struct smh_object_index *index = object->index;
+
+    if(index == NULL){
+        for(size_t i = 0; i < object->length; i++){
+            if(object->keys[i].cstr == symbol) return &object->values[i];
+        }
+
+        return NULL;
+    }
+
+    uint64_t hash = ((const uint64_t*) symbol)[-1];
+
+    for(size_t slot = hash & index->mask; index->slots[slot]; slot = (slot + 1) & index->mask){
+        size_t entry = index->slots[slot] - 1;
+
+        if(object->keys[entry].cstr == symbol) return &object->values[entry];
+    }
+
+    return NULL;
+}
+
+enum smh_query_step_kind {
+    SMH_QUERY_KEY,
+    SMH_QUERY_INDEX,
+    SMH_QUERY_WILDCARD,
+};
+
+struct smh_query_step {
+    enum smh_query_step_kind kind;
+    struct smh_key key;
+    size_t index;
+};
+
+struct smh_query {
+    struct smh_query_step *steps;
+    size_t length;
+
+    // Keys point into this copy of the path
+    char *path;
+};
+
+struct smh_query *smh_query_compile(const char *path){
+    struct smh_query *query = smh_malloc(sizeof *query);
+    size_t path_length = strlen(path);
+
+    query->path = smh_malloc(path_length + 1);
+    memcpy(query->path, path, path_length + 1);
+
+    // Every step takes at least one character
+    query->steps = smh_malloc(sizeof *query->steps * (path_length ? path_length : 1));
+    query->length = 0;
+
+    const char *p = query->path;
+
+    bool malformed = false;
+
+    while(!malformed && *p){
+        struct smh_query_step *step = &query->steps[query->length++];
+
+        if(*p == '['){
+            p++;
+
+            if(*p == '*'){
+                step->kind = SMH_QUERY_WILDCARD;
+                p++;
+            } else if(*p >= '0' && *p <= '9'){
+                step->kind = SMH_QUERY_INDEX;
+                step->index = 0;
+
+                while(*p >= '0' && *p <= '9'){
+                    size_t digit = (size_t) (*p++ - '0');
+
+                    // Indices that don't fit would otherwise wrap around to small ones
+                    if(step->index > (SIZE_MAX - digit) / 10){
+                        malformed = true;
+                        break;
+                    }
+
+                    step->index = step->index * 10 + digit;
+                }
+
+                if(malformed) break;
+            } else {
+                malformed = true;
+                break;
+            }
+
+            malformed = *p++ != ']';
+            continue;
+        }
+
+        // Keys are preceded by a dot, which is optional at the start of the path
+        if(*p == '.'){
+            p++;
+        } else if(query->length != 1){
+            malformed = true;
+            break;
+        }
+
+        const char *end = p + strcspn(p, ".[");
+
+        if(end == p){
+            malformed = true;
+            break;
+        }
+
+        if(end - p == 1 && *p == '*'){
+            step->kind = SMH_QUERY_WILDCARD;
+        } else {
+            step->kind = SMH_QUERY_KEY;
+            step->key = smh_key(p, (size_t) (end - p));
+        }
+
+        p = end;
+    }
+
+    if(malformed){
+        smh_query_free(query);
+        return NULL;
+    }
+
+    return query;
+}
+
+void smh_query_free(struct smh_query *query){
+    smh_free(query->steps);
+    smh_free(query->path);
+    smh_free(query);
+}
+
+struct smh_query_matches {
+    struct smh_dict **matches;
+    size_t capacity;
+    size_t count;
+    bool first_only;
+};
+
+// Follows the steps from 'step' onwards, returns false once no more matches are wanted
+static bool smh_query_walk(const struct smh_query *query, size_t step, struct smh_dict *dict, struct smh_query_matches *matches){
+    if(step == query->length){
+        if(matches->count < matches->capacity) matches->matches[matches->count] = dict;
+        matches->count++;
+        return !matches->first_only;
+    }
+
+    const struct smh_query_step *current = &query->steps[step];
+
+    switch(current->kind){
+    case SMH_QUERY_KEY: {
+            if(dict->kind != SMH_DICT_OBJECT) return true;
+
+            struct smh_dict *value = smh_object_get_key(&dict->as_object, &current->key);
+            return value == NULL || smh_query_walk(query, step + 1, value, matches);
+        }
+    case SMH_QUERY_INDEX:
+        if(dict->kind != SMH_DICT_ARRAY || current->index >= dict->as_array.length) return true;
+        return smh_query_walk(query, step + 1, &dict->as_array.items[current->index], matches);
+    case SMH_QUERY_WILDCARD:
+        if(dict->kind == SMH_DICT_ARRAY){
+            for(size_t i = 0; i < dict->as_array.length; i++){
+                if(!smh_query_walk(query, step + 1, &dict->as_array.items[i], matches)) return false;
+            }
+        } else if(dict->kind == SMH_DICT_OBJECT){
+            for(size_t i = 0; i < dict->as_object.length; i++){
+                if(!smh_query_walk(query, step + 1, &dict->as_object.values[i], matches)) return false;
+            }
+        }
+        return true;
+    }
+
+    return true;
+}
+
+struct smh_dict *smh_query_first(const struct smh_query *query, struct smh_dict *dict){
+    struct smh_dict *match = NULL;
+    struct smh_query_matches matches = { &match, 1, 0, true };
+
+    smh_query_walk(query, 0, dict, &matches);
+    return match;
+}
+
+size_t smh_query_all(const struct smh_query *query, struct smh_dict *dict, struct smh_dict **matches, size_t capacity){
+    struct smh_query_matches found = { matches, capacity, 0, false };
+
+    smh_query_walk(query, 0, dict, &found);
+    return found.count;
 }
 
 struct smh_failure smh_failure(enum smh_errorcode errorcode){
@@ -190,6 +1502,7 @@ static struct smh_result smh_result_success(struct smh_dict dict){
     struct smh_result result;
     result.ok = true;
     result.as_success = dict;
+    result.arena = NULL;
     return result;
 }
 
@@ -197,13 +1510,88 @@ static struct smh_result smh_result_failure(struct smh_failure failure){
     struct smh_result result;
     result.ok = false;
     result.as_failure = failure;
+    result.arena = NULL;
     return result;
 }
 
-static void smh_parser_create(struct smh_parser *parser, unsigned long long index, const char *markup){
+static void smh_parser_create(struct smh_parser *parser, unsigned long long index, const char *markup, size_t length){
     parser->index = index;
     parser->markup = markup;
-    parser->length = strlen(markup);
+    parser->length = length;
+    parser->arena = NULL;
+    parser->borrow_strings = false;
+    parser->symbols = NULL;
+    parser->intern_values = 0;
+    parser->structural_index = NULL;
+    parser->cursor = 0;
+    parser->line = 0;
+    parser->handler = NULL;
+    parser->scratch = NULL;
+    parser->scratch_capacity = 0;
+    parser->frames = parser->inline_frames;
+    parser->frames_capacity = SMH_PARSER_INLINE_FRAMES;
+    parser->depth = 0;
+    parser->max_depth = SMH_PARSER_MAX_DEPTH;
+    parser->region_level = SMH_NO_REGION;
+    parser->region_kind = SMH_DICT_ARRAY;
+    parser->region_hazards = 0;
+    parser->region_final_level = 0;
+
+    #ifdef SMH_PARSER_STATS
+        parser->stats = NULL;
+    #endif
+}
+
+static void *smh_parser_alloc(struct smh_parser *parser, size_t size){
+    return parser->arena ? smh_arena_alloc(parser->arena, size) : smh_malloc(size);
+}
+
+static void *smh_parser_grow(struct smh_parser *parser, void *pointer, size_t *capacity, size_t needed, size_t element_size){
+    if(needed <= *capacity) return pointer;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 4;
+
+    while(new_capacity < needed){
+        new_capacity *= 2;
+    }
+
+    if(parser->arena){
+        pointer = smh_arena_realloc(parser->arena, pointer, *capacity * element_size, new_capacity * element_size);
+    } else {
+        pointer = smh_realloc(pointer, new_capacity * element_size);
+    }
+
+    *capacity = new_capacity;
+    return pointer;
+}
+
+// Buffer for decoding escaped strings, reused for every string of a parse
+static char *smh_parser_grow_scratch(struct smh_parser *parser, size_t needed){
+    if(needed > parser->scratch_capacity){
+        parser->scratch_capacity = parser->scratch_capacity ? parser->scratch_capacity * 2 : 64;
+
+        while(parser->scratch_capacity < needed){
+            parser->scratch_capacity *= 2;
+        }
+
+        parser->scratch = smh_realloc(parser->scratch, parser->scratch_capacity);
+    }
+
+    return parser->scratch;
+}
+
+// Memory from an arena is only reclaimed all at once, so discarding is a no-op for arenas
+
+static void smh_parser_discard(struct smh_parser *parser, struct smh_dict *dict){
+    if(!parser->arena) smh_dict_free(dict);
+}
+
+static void smh_parser_discard_dicts(struct smh_parser *parser, struct smh_dict *dicts, size_t length){
+    if(!parser->arena) smh_dicts_free(dicts, length);
+}
+
+static void smh_parser_discard_strings(struct smh_parser *parser, struct smh_string *strings, size_t length){
+    if(!parser->arena) smh_strings_free(strings, length);
 }
 
 static char smh_parser_peek(struct smh_parser *parser){
@@ -214,361 +1602,3717 @@ static char smh_parser_peek_ahead(struct smh_parser *parser, size_t amount){
     return parser->index + amount < parser->length ? parser->markup[parser->index + amount] : '\0';
 }
 
-static size_t smh_parser_ignore(struct smh_parser *parser, char character){
-    size_t beginning = parser->index;
+// Scanning kernels find the first byte at or after 'index' that is one of
+// the four 'needles', or return 'length' if there isn't one
+
+static size_t smh_scan_scalar(const char *data, size_t index, size_t length, const char needles[4]){
+    for(; index < length; index++){
+        char character = data[index];
+
+        if(character == needles[0] || character == needles[1] || character == needles[2] || character == needles[3]){
+            return index;
+        }
+    }
+
+    return index;
+}
+
+#ifdef SMH_PARSER_USE_SSE2
+    static size_t smh_scan_sse2(const char *data, size_t index, size_t length, const char needles[4]){
+        __m128i n0 = _mm_set1_epi8(needles[0]);
+        __m128i n1 = _mm_set1_epi8(needles[1]);
+        __m128i n2 = _mm_set1_epi8(needles[2]);
+        __m128i n3 = _mm_set1_epi8(needles[3]);
+
+        while(index + 16 <= length){
+            __m128i chunk = _mm_loadu_si128((const __m128i*) &data[index]);
+            __m128i hits = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, n0), _mm_cmpeq_epi8(chunk, n1)),
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, n2), _mm_cmpeq_epi8(chunk, n3))
+            );
+
+            unsigned int mask = (unsigned int) _mm_movemask_epi8(hits);
+            if(mask) return index + __builtin_ctz(mask);
+
+            index += 16;
+        }
+
+        return smh_scan_scalar(data, index, length, needles);
+    }
+#endif // SMH_PARSER_USE_SSE2
+
+#ifdef SMH_PARSER_USE_AVX2
+    __attribute__((target("avx2")))
+    static size_t smh_scan_avx2(const char *data, size_t index, size_t length, const char needles[4]){
+        __m256i n0 = _mm256_set1_epi8(needles[0]);
+        __m256i n1 = _mm256_set1_epi8(needles[1]);
+        __m256i n2 = _mm256_set1_epi8(needles[2]);
+        __m256i n3 = _mm256_set1_epi8(needles[3]);
+
+        while(index + 32 <= length){
+            __m256i chunk = _mm256_loadu_si256((const __m256i*) &data[index]);
+            __m256i hits = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, n0), _mm256_cmpeq_epi8(chunk, n1)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, n2), _mm256_cmpeq_epi8(chunk, n3))
+            );
+
+            unsigned int mask = (unsigned int) _mm256_movemask_epi8(hits);
+            if(mask) return index + __builtin_ctz(mask);
+
+            index += 32;
+        }
+
+        return smh_scan_sse2(data, index, length, needles);
+    }
+
+    // Kernels are chosen once when the program starts instead of on every call (see smh_choose_kernels),
+    // anything running before that uses the SSE2 ones
+    static size_t (*smh_scan_kernel)(const char *data, size_t index, size_t length, const char needles[4]) = smh_scan_sse2;
+#endif // SMH_PARSER_USE_AVX2
+
+static void smh_needles(const char *terminators, char needles[4]){
+    memset(needles, 0, 4);
+
+    for(size_t i = 0; i < 3 && terminators[i]; i++){
+        needles[i] = terminators[i];
+    }
+}
+
+// Finds the next byte that is either one of up to three 'terminators' or a null character
+static size_t smh_scan(const char *data, size_t index, size_t length, const char *terminators){
+    char needles[4];
+    smh_needles(terminators, needles);
+
+    #if defined(SMH_PARSER_USE_AVX2)
+        return smh_scan_kernel(data, index, length, needles);
+    #elif defined(SMH_PARSER_USE_SSE2)
+        return smh_scan_sse2(data, index, length, needles);
+    #else
+        return smh_scan_scalar(data, index, length, needles);
+    #endif
+}
+
+// Stage 1 of indexed parsing: classify the markup in bulk and record the offsets of
+// structural characters, which are the terminators of strings plus null characters
+
+#define SMH_INDEX_STRUCTURALS "\n:,]\"\\"
+
+static void smh_index_reserve(struct smh_index *index, size_t additional){
+    if(index->count + additional <= index->capacity) return;
+
+    while(index->count + additional > index->capacity){
+        index->capacity = index->capacity ? index->capacity * 2 : 1024;
+    }
+
+    index->offsets = smh_realloc(index->offsets, sizeof *index->offsets * index->capacity);
+}
+
+// Records a structural character, and the indentation after it when it ends a line
+static void smh_index_push(struct smh_index *index, const char *data, size_t length, size_t position){
+    index->offsets[index->count++] = position;
+    if(data[position] != '\n') return;
+
+    if(index->lines == index->lines_capacity){
+        index->lines_capacity = index->lines_capacity ? index->lines_capacity * 2 : 256;
+        index->spaces = smh_realloc(index->spaces, sizeof *index->spaces * index->lines_capacity);
+    }
+
+    uint32_t spaces = 0;
+
+    while(position + 1 + spaces < length && data[position + 1 + spaces] == ' '){
+        spaces++;
+    }
+
+    index->spaces[index->lines++] = spaces;
+}
+
+static void smh_index_classify_scalar(struct smh_index *index, const char *data, size_t position, size_t length){
+    for(; position < length; position++){
+        char character = data[position];
+
+        if(character == '\0' || strchr(SMH_INDEX_STRUCTURALS, character)){
+            smh_index_reserve(index, 1);
+            smh_index_push(index, data, length, position);
+        }
+    }
+}
+
+#ifdef SMH_PARSER_USE_SSE2
+    static void smh_index_push_mask(struct smh_index *index, const char *data, size_t length, size_t base, uint32_t mask){
+        while(mask){
+            smh_index_push(index, data, length, base + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+
+    static void smh_index_classify_sse2(struct smh_index *index, const char *data, size_t position, size_t length){
+        const char *structurals = SMH_INDEX_STRUCTURALS;
+        __m128i needles[7];
+
+        for(int i = 0; i < 7; i++){
+            needles[i] = _mm_set1_epi8(structurals[i]);
+        }
+
+        for(; position + 16 <= length; position += 16){
+            __m128i chunk = _mm_loadu_si128((const __m128i*) &data[position]);
+            __m128i hits = _mm_cmpeq_epi8(chunk, needles[0]);
+
+            for(int i = 1; i < 7; i++){
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[i]));
+            }
+
+            smh_index_reserve(index, 16);
+            smh_index_push_mask(index, data, length, position, (uint32_t) _mm_movemask_epi8(hits));
+        }
+
+        smh_index_classify_scalar(index, data, position, length);
+    }
+#endif // SMH_PARSER_USE_SSE2
+
+#ifdef SMH_PARSER_USE_AVX2
+    __attribute__((target("avx2")))
+    static void smh_index_classify_avx2(struct smh_index *index, const char *data, size_t position, size_t length){
+        // Classify by nibble lookup, each structural character gets a bit that is
+        // only set in the entries for both its low nibble and its high nibble
+        const __m256i low_table = _mm256_setr_epi8(
+            0x01, 0, 0x20, 0, 0, 0, 0, 0, 0, 0, 0x06, 0, 0x48, 0x10, 0, 0,
+            0x01, 0, 0x20, 0, 0, 0, 0, 0, 0, 0, 0x06, 0, 0x48, 0x10, 0, 0
+        );
+        const __m256i high_table = _mm256_setr_epi8(
+            0x03, 0, 0x28, 0x04, 0, 0x50, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0x03, 0, 0x28, 0x04, 0, 0x50, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        );
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+        const __m256i zero = _mm256_setzero_si256();
+
+        for(; position + 32 <= length; position += 32){
+            __m256i chunk = _mm256_loadu_si256((const __m256i*) &data[position]);
+            __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(chunk, nibble_mask));
+            __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask));
+            __m256i misses = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero);
+
+            smh_index_reserve(index, 32);
+            smh_index_push_mask(index, data, length, position, ~(uint32_t) _mm256_movemask_epi8(misses));
+        }
+
+        smh_index_classify_sse2(index, data, position, length);
+    }
+
+    static void (*smh_index_classify_kernel)(struct smh_index *index, const char *data, size_t position, size_t length) = smh_index_classify_sse2;
+
+    __attribute__((constructor))
+    static void smh_choose_kernels(void){
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx2")){
+            smh_scan_kernel = smh_scan_avx2;
+            smh_index_classify_kernel = smh_index_classify_avx2;
+        }
+    }
+#endif // SMH_PARSER_USE_AVX2
+
+static void smh_index_create(struct smh_index *index, const char *data, size_t length){
+    index->offsets = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->spaces = NULL;
+    index->lines = 0;
+    index->lines_capacity = 0;
+
+    smh_index_reserve(index, length / 8 + 1);
+
+    #if defined(SMH_PARSER_USE_AVX2)
+        smh_index_classify_kernel(index, data, 0, length);
+    #elif defined(SMH_PARSER_USE_SSE2)
+        smh_index_classify_sse2(index, data, 0, length);
+    #else
+        smh_index_classify_scalar(index, data, 0, length);
+    #endif
+}
+
+static void smh_index_free(struct smh_index *index){
+    smh_free(index->offsets);
+    smh_free(index->spaces);
+}
+
+// Moves the cursor to the first structural character at or after 'position',
+// counting the newlines it passes so that their indentation can be found
+static size_t smh_parser_seek(struct smh_parser *parser, size_t position){
+    struct smh_index *index = parser->structural_index;
+    size_t cursor = parser->cursor;
+
+    while(cursor > 0 && index->offsets[cursor - 1] >= position){
+        cursor--;
+        if(parser->markup[index->offsets[cursor]] == '\n') parser->line--;
+    }
+
+    while(cursor < index->count && index->offsets[cursor] < position){
+        if(parser->markup[index->offsets[cursor]] == '\n') parser->line++;
+        cursor++;
+    }
+
+    parser->cursor = cursor;
+    return cursor;
+}
+
+// Stage 2 of indexed parsing: find terminators by walking the index instead of the markup
+static size_t smh_parser_find(struct smh_parser *parser, const char *terminators){
+    if(parser->structural_index == NULL){
+        return smh_scan(parser->markup, parser->index, parser->length, terminators);
+    }
+
+    struct smh_index *index = parser->structural_index;
+    char needles[4];
+    smh_needles(terminators, needles);
+
+    for(size_t cursor = smh_parser_seek(parser, parser->index); cursor < index->count; cursor++){
+        char character = parser->markup[index->offsets[cursor]];
+
+        if(character == needles[0] || character == needles[1] || character == needles[2] || character == needles[3]){
+            parser->cursor = cursor;
+            return index->offsets[cursor];
+        }
+
+        if(character == '\n') parser->line++;
+    }
+
+    parser->cursor = index->count;
+    return parser->index > parser->length ? parser->index : parser->length;
+}
+
+static size_t smh_parser_ignore(struct smh_parser *parser, char character){
+    size_t beginning = parser->index;
+
+    // Indentation is already known when the index is available
+    if(character == ' ' && parser->structural_index && beginning != 0 && beginning <= parser->length && parser->markup[beginning - 1] == '\n'){
+        smh_parser_seek(parser, beginning - 1);
+        parser->index += parser->structural_index->spaces[parser->line];
+        return parser->index - beginning;
+    }
+
+    while(smh_parser_peek(parser) == character){
+        parser->index++;
+    }
+
+    return parser->index - beginning;
+}
+
+#ifdef SMH_PARSER_STATS
+    #define smh_parser_count(PARSER_PTR, FIELD, AMOUNT) do {\
+            if((PARSER_PTR)->stats) (PARSER_PTR)->stats->FIELD += (AMOUNT); \
+        } while(0)
+#else
+    #define smh_parser_count(PARSER_PTR, FIELD, AMOUNT) do {} while(0)
+#endif
+
+#define smh_parser_forbid(PARSER_PTR, CHARACTER, ERRORCODE) do {\
+        if(smh_parser_peek((PARSER_PTR)) == (CHARACTER)){\
+            return (ERRORCODE); \
+        } \
+    } while(0);
+
+// The grammar reports what it parses as events to the parser's handler,
+// which is either the tree builder or a user-supplied handler
+
+static bool smh_parser_emit_begin_array(struct smh_parser *parser){
+    smh_parser_count(parser, nodes[SMH_DICT_ARRAY], 1);
+    return parser->handler->begin_array == NULL || parser->handler->begin_array(parser->handler->user);
+}
+
+static bool smh_parser_emit_end_array(struct smh_parser *parser){
+    return parser->handler->end_array == NULL || parser->handler->end_array(parser->handler->user);
+}
+
+static bool smh_parser_emit_begin_object(struct smh_parser *parser){
+    smh_parser_count(parser, nodes[SMH_DICT_OBJECT], 1);
+    return parser->handler->begin_object == NULL || parser->handler->begin_object(parser->handler->user);
+}
+
+static bool smh_parser_emit_key(struct smh_parser *parser, const char *data, size_t length){
+    return parser->handler->key == NULL || parser->handler->key(parser->handler->user, data, length);
+}
+
+static bool smh_parser_emit_string(struct smh_parser *parser, const char *data, size_t length){
+    smh_parser_count(parser, nodes[SMH_DICT_STRING], 1);
+    return parser->handler->string == NULL || parser->handler->string(parser->handler->user, data, length);
+}
+
+static bool smh_parser_emit_end_object(struct smh_parser *parser){
+    return parser->handler->end_object == NULL || parser->handler->end_object(parser->handler->user);
+}
+
+static bool smh_parser_did_parse_completely(struct smh_parser *parser){
+    while(parser->index < parser->length){
+        char character = parser->markup[parser->index];
+
+        if(character != '\n' && character != ' '){
+            return false;
+        }
+
+        parser->index++;
+    }
+
+    return true;
+}
+
+// Whether only blank lines remain, which maps skip over before looking for their next key
+static bool smh_parser_rest_is_newlines(struct smh_parser *parser){
+    for(size_t i = parser->index; i < parser->length; i++){
+        if(parser->markup[i] != '\n') return false;
+    }
+
+    return true;
+}
+
+static enum smh_errorcode smh_parser_parse_quoted_string(struct smh_parser *parser){
+    parser->index++;
+
+    size_t start = parser->index;
+    size_t end = smh_parser_find(parser, "\"\\");
+
+    // Strings without escapes are passed along as they appear in the markup
+    if(end < parser->length && parser->markup[end] == '"'){
+        parser->index = end + 1;
+        return smh_parser_emit_string(parser, &parser->markup[start], end - start) ? SMH_ERRORCODE_NONE : SMH_ERRORCODE_ABORTED;
+    }
+
+    // Otherwise decode them into the scratch buffer, unless nobody is listening
+    bool decode = parser->handler->string != NULL;
+    size_t length = 0;
+    char character;
+
+    for(;;){
+        // Copy everything up until the next quote or escape at once
+        end = smh_parser_find(parser, "\"\\");
+        size_t span = end > parser->index ? end - parser->index : 0;
+
+        if(decode){
+            parser->scratch = smh_parser_grow_scratch(parser, length + span + 1);
+            memcpy(&parser->scratch[length], &parser->markup[parser->index], span);
+        }
+
+        length += span;
+
+        parser->index += span;
+        character = smh_parser_peek(parser);
+
+        if(character != '\\') break;
+
+        char substitution;
+
+        switch(smh_parser_peek_ahead(parser, 1)){
+        case 'n':
+            substitution = '\n';
+            break;
+        case '"':
+            substitution = '\"';
+            break;
+        case '\\':
+            substitution = '\\';
+            break;
+        default:
+            substitution = '\0';
+        }
+
+        if(substitution){
+            if(decode) parser->scratch[length] = substitution;
+            length++;
+        }
+
+        parser->index += 2;
+    }
+
+    if(!character){
+        return SMH_ERRORCODE_UNTERMINATED;
+    }
+
+    parser->index++;
+    return smh_parser_emit_string(parser, parser->scratch, length) ? SMH_ERRORCODE_NONE : SMH_ERRORCODE_ABORTED;
+}
+
+static enum smh_errorcode smh_parser_make_unquoted_string(struct smh_parser *parser, size_t end){
+    size_t start = parser->index;
+    size_t length = end > start ? end - start : 0;
+
+    parser->index = start + length;
+    return smh_parser_emit_string(parser, &parser->markup[start], length) ? SMH_ERRORCODE_NONE : SMH_ERRORCODE_ABORTED;
+}
+
+static enum smh_errorcode smh_parser_parse_unquoted_string(struct smh_parser *parser, const char *terminators){
+    return smh_parser_make_unquoted_string(parser, smh_parser_find(parser, terminators));
+}
+
+// Containers being parsed are kept on an explicit stack instead of the native one
+static enum smh_errorcode smh_parser_push(struct smh_parser *parser, enum smh_parent_kind kind, size_t level){
+    if(parser->depth >= parser->max_depth){
+        return SMH_ERRORCODE_TOO_DEEP;
+    }
+
+    if(parser->depth == parser->frames_capacity){
+        size_t capacity = parser->frames_capacity * 2;
+
+        if(parser->frames == parser->inline_frames){
+            parser->frames = smh_malloc(sizeof *parser->frames * capacity);
+            memcpy(parser->frames, parser->inline_frames, sizeof parser->inline_frames);
+        } else {
+            parser->frames = smh_realloc(parser->frames, sizeof *parser->frames * capacity);
+        }
+
+        parser->frames_capacity = capacity;
+    }
+
+    parser->frames[parser->depth].kind = kind;
+    parser->frames[parser->depth].level = level;
+    parser->depth++;
+
+    #ifdef SMH_PARSER_STATS
+        if(parser->stats && parser->depth > parser->stats->max_depth){
+            parser->stats->max_depth = parser->depth;
+        }
+    #endif
+    return SMH_ERRORCODE_NONE;
+}
+
+static enum smh_errorcode smh_parser_open_bullet_array(struct smh_parser *parser, size_t level){
+    enum smh_errorcode errorcode = smh_parser_push(parser, SMH_PARENT_BULLET, level);
+    if(errorcode) return errorcode;
+
+    parser->index++;
+    smh_parser_ignore(parser, ' ');
+
+    return smh_parser_emit_begin_array(parser) ? SMH_ERRORCODE_NONE : SMH_ERRORCODE_ABORTED;
+}
+
+static enum smh_errorcode smh_parser_open_map(struct smh_parser *parser, size_t level){
+    enum smh_errorcode errorcode = smh_parser_push(parser, SMH_PARENT_MAP, level);
+    if(errorcode) return errorcode;
+
+    return smh_parser_emit_begin_object(parser) ? SMH_ERRORCODE_NONE : SMH_ERRORCODE_ABORTED;
+}
+
+// Emits the key of the map entry whose colon is at 'end', leaving the parser at its value
+static enum smh_errorcode smh_parser_begin_map_entry(struct smh_parser *parser, size_t end){
+    if(!smh_parser_emit_key(parser, &parser->markup[parser->index], end - parser->index)){
+        return SMH_ERRORCODE_ABORTED;
+    }
+
+    parser->index = end + 1;
+    return SMH_ERRORCODE_NONE;
+}
+
+static void smh_parser_close_bullet_array(struct smh_parser *parser, size_t level){
+    if(parser->region_level != SMH_NO_REGION){
+        if(parser->depth == 1){
+            parser->region_final_level = level;
+        } else if(level <= parser->region_level && parser->index >= parser->length){
+            parser->region_hazards |= SMH_REGION_OPEN_BULLET;
+        }
+    }
+
+    parser->depth--;
+}
+
+static void smh_parser_close_map(struct smh_parser *parser, size_t level){
+    if(parser->depth > 1 && level == parser->region_level && smh_parser_rest_is_newlines(parser)){
+        parser->region_hazards |= SMH_REGION_OPEN_MAP;
+    }
+
+    parser->depth--;
+}
+
+// Parses a value along with everything nested inside of it, then keeps finishing
+// the containers it is in until only 'base' containers remain open
+static enum smh_errorcode smh_parser_parse_value(struct smh_parser *parser, size_t base, enum smh_parent_kind parent_kind, size_t preexisting_indentation){
+    enum smh_errorcode errorcode;
+
+    for(;;){
+        smh_parser_ignore(parser, '\n');
+        smh_parser_forbid(parser, '\t', SMH_ERRORCODE_TAB_NOT_ALLOWED);
+
+        size_t level = smh_parser_ignore(parser, ' ') / 2 + preexisting_indentation;
+
+        smh_parser_forbid(parser, '\t', SMH_ERRORCODE_TAB_NOT_ALLOWED);
+
+        if(parser->index >= parser->length && parser->region_level != SMH_NO_REGION){
+            parser->region_hazards |= SMH_REGION_OPEN_VALUE;
+        }
+
+        bool opened_bracket = false;
+
+        if(smh_parser_peek(parser) == '"'){
+            errorcode = smh_parser_parse_quoted_string(parser);
+            if(errorcode) return errorcode;
+        } else if(smh_parser_peek(parser) == '['){
+            errorcode = smh_parser_push(parser, SMH_PARENT_BRACKET, 0);
+            if(errorcode) return errorcode;
+
+            parser->index++;
+            if(!smh_parser_emit_begin_array(parser)) return SMH_ERRORCODE_ABORTED;
+
+            opened_bracket = true;
+        } else if(smh_parser_peek(parser) == '-' && smh_parser_peek_ahead(parser, 1) == ' '){
+            errorcode = smh_parser_open_bullet_array(parser, level);
+            if(errorcode) return errorcode;
+
+            parent_kind = SMH_PARENT_BULLET;
+            preexisting_indentation = level;
+            continue;
+        } else if(parent_kind == SMH_PARENT_BRACKET){
+            errorcode = smh_parser_parse_unquoted_string(parser, "\n,]");
+            if(errorcode) return errorcode;
+        } else {
+            // Look ahead for a colon instead of speculatively parsing a string
+            size_t end = smh_parser_find(parser, "\n:");
+
+            if(end < parser->length && parser->markup[end] == ':'){
+                errorcode = smh_parser_open_map(parser, parent_kind == SMH_PARENT_BULLET ? level + 1 : level);
+                if(errorcode) return errorcode;
+
+                errorcode = smh_parser_begin_map_entry(parser, end);
+                if(errorcode) return errorcode;
+
+                parent_kind = SMH_PARENT_MAP;
+                preexisting_indentation = 0;
+                continue;
+            }
+
+            errorcode = smh_parser_make_unquoted_string(parser, end);
+            if(errorcode) return errorcode;
+        }
+
+        // Continue with whichever container the value is in, closing containers that have ended
+        bool next_value = false;
+
+        while(!next_value){
+            if(parser->depth == base) return SMH_ERRORCODE_NONE;
+
+            struct smh_parser_frame *frame = &parser->frames[parser->depth - 1];
+
+            switch(frame->kind){
+            case SMH_PARENT_BRACKET:
+                if(!opened_bracket){
+                    smh_parser_ignore(parser, '\n');
+
+                    if(smh_parser_peek(parser) == ','){
+                        parser->index++;
+                    }
+                }
+
+                opened_bracket = false;
+
+                if(parser->index >= parser->length){
+                    return SMH_ERRORCODE_UNTERMINATED;
+                }
+
+                smh_parser_ignore(parser, '\n');
+                smh_parser_ignore(parser, ' ');
+
+                if(smh_parser_peek(parser) == ']'){
+                    parser->index++;
+                    parser->depth--;
+                    if(!smh_parser_emit_end_array(parser)) return SMH_ERRORCODE_ABORTED;
+                    break;
+                }
+
+                parent_kind = SMH_PARENT_BRACKET;
+                preexisting_indentation = 0;
+                next_value = true;
+                break;
+            case SMH_PARENT_BULLET:
+                smh_parser_ignore(parser, ' ');
+
+                if(smh_parser_peek(parser) == '\n'){
+                    size_t start_of_line = parser->index++;
+                    size_t indentation = smh_parser_ignore(parser, ' ') / 2;
+
+                    if(indentation >= frame->level && smh_parser_peek(parser) == '-' && smh_parser_peek_ahead(parser, 1) == ' '){
+                        parser->index++;
+                        smh_parser_ignore(parser, ' ');
+
+                        frame->level = indentation;
+                        parent_kind = SMH_PARENT_BULLET;
+                        preexisting_indentation = indentation;
+                        next_value = true;
+                        break;
+                    }
+
+                    smh_parser_count(parser, rewinds, 1);
+                    smh_parser_count(parser, bytes_scanned, parser->index - start_of_line);
+                    parser->index = start_of_line;
+                }
+
+                smh_parser_close_bullet_array(parser, frame->level);
+                if(!smh_parser_emit_end_array(parser)) return SMH_ERRORCODE_ABORTED;
+                break;
+            default:
+                if(smh_parser_peek(parser) == '\n'){
+                    size_t start = parser->index;
+
+                    smh_parser_ignore(parser, '\n');
+                    size_t indentation = smh_parser_ignore(parser, ' ') / 2;
+
+                    if(indentation == frame->level){
+                        size_t end = smh_parser_find(parser, "\n:");
+
+                        if(end < parser->length && parser->markup[end] == ':'){
+                            errorcode = smh_parser_begin_map_entry(parser, end);
+                            if(errorcode) return errorcode;
+
+                            parent_kind = SMH_PARENT_MAP;
+                            preexisting_indentation = 0;
+                            next_value = true;
+                            break;
+                        }
+                    }
+
+                    smh_parser_count(parser, rewinds, 1);
+                    smh_parser_count(parser, bytes_scanned, parser->index - start);
+                    parser->index = start;
+                }
+
+                smh_parser_close_map(parser, frame->level);
+                if(!smh_parser_emit_end_object(parser)) return SMH_ERRORCODE_ABORTED;
+                break;
+            }
+        }
+    }
+}
+
+static enum smh_errorcode smh_parser_parse(struct smh_parser *parser, enum smh_parent_kind parent_kind, size_t preexisting_indentation){
+    return smh_parser_parse_value(parser, parser->depth, parent_kind, preexisting_indentation);
+}
+
+// Frees memory that is only needed while parsing
+static void smh_parser_release(struct smh_parser *parser){
+    smh_free(parser->scratch);
+    parser->scratch = NULL;
+    parser->scratch_capacity = 0;
+
+    if(parser->frames != parser->inline_frames){
+        smh_free(parser->frames);
+        parser->frames = parser->inline_frames;
+        parser->frames_capacity = SMH_PARSER_INLINE_FRAMES;
+    }
+}
+
+static enum smh_errorcode smh_parser_run(struct smh_parser *parser){
+    enum smh_errorcode errorcode = smh_parser_parse(parser, SMH_PARENT_NULL, 0);
+
+    if(errorcode == SMH_ERRORCODE_NONE && !smh_parser_did_parse_completely(parser)){
+        errorcode = SMH_ERRORCODE_UNABLE_TO_PARSE;
+    }
+
+    smh_parser_release(parser);
+    return errorcode;
+}
+
+// Parses a region cut out of a larger document, which holds consecutive entries
+// of the document's top-level bullet array or map
+static enum smh_errorcode smh_parser_run_region(struct smh_parser *parser){
+    smh_parser_ignore(parser, '\n');
+    smh_parser_ignore(parser, ' ');
+
+    enum smh_errorcode errorcode;
+
+    if(parser->region_kind == SMH_DICT_ARRAY){
+        errorcode = smh_parser_open_bullet_array(parser, parser->region_level);
+
+        if(errorcode == SMH_ERRORCODE_NONE){
+            errorcode = smh_parser_parse_value(parser, 0, SMH_PARENT_BULLET, parser->region_level);
+        }
+    } else {
+        errorcode = smh_parser_open_map(parser, parser->region_level);
+
+        if(errorcode == SMH_ERRORCODE_NONE){
+            errorcode = smh_parser_begin_map_entry(parser, smh_parser_find(parser, "\n:"));
+        }
+
+        if(errorcode == SMH_ERRORCODE_NONE){
+            errorcode = smh_parser_parse_value(parser, 0, SMH_PARENT_NULL, 0);
+        }
+    }
+
+    smh_parser_release(parser);
+    return errorcode;
+}
+
+// Whether a region parsed the same as it would have as part of the whole document.
+// Unless it's the last region, its top-level container must reach its very end
+// in order to continue with the next region
+static bool smh_parser_region_is_complete(struct smh_parser *parser, bool last){
+    if(last) return smh_parser_did_parse_completely(parser);
+
+    unsigned int hazards = SMH_REGION_OPEN_VALUE | SMH_REGION_OPEN_MAP;
+    if(parser->region_kind == SMH_DICT_ARRAY) hazards |= SMH_REGION_OPEN_BULLET;
+    if(parser->region_hazards & hazards) return false;
+
+    if(parser->region_kind == SMH_DICT_ARRAY){
+        return parser->index >= parser->length && parser->region_final_level == parser->region_level;
+    }
+
+    return smh_parser_rest_is_newlines(parser);
+}
+
+// The tree builder turns events back into a document
+
+struct smh_builder_frame {
+    enum smh_dict_kind kind;
+    struct smh_dict *values;
+    struct smh_string *keys;
+    size_t length;
+    size_t values_capacity;
+    size_t keys_capacity;
+    bool has_pending_key;
+};
+
+struct smh_builder {
+    struct smh_parser *parser;
+    struct smh_builder_frame *frames;
+    size_t depth;
+    size_t capacity;
+    struct smh_dict root;
+    bool has_root;
+};
+
+static struct smh_dict smh_builder_string(struct smh_builder *builder, const char *data, size_t length, bool intern){
+    struct smh_parser *parser = builder->parser;
+
+    if(intern){
+        struct smh_dict dict = smh_dict_string_view(smh_symbol(parser->symbols, data, length), length);
+        dict.as_string.storage = SMH_STRING_INTERNED;
+        return dict;
+    }
+
+    if(parser->borrow_strings && data >= parser->markup && data + length <= parser->markup + parser->length){
+        return smh_dict_string_view(data, length);
+    }
+
+    char *content = smh_parser_alloc(parser, length + 1);
+    if(length) memcpy(content, data, length);
+    content[length] = '\0';
+    smh_parser_count(parser, bytes_copied, length);
+    return smh_dict_string(content, length);
+}
+
+static void smh_builder_deliver(struct smh_builder *builder, struct smh_dict value){
+    if(builder->depth == 0){
+        builder->root = value;
+        builder->has_root = true;
+        return;
+    }
+
+    struct smh_builder_frame *frame = &builder->frames[builder->depth - 1];
+    frame->values = smh_parser_grow(builder->parser, frame->values, &frame->values_capacity, frame->length + 1, sizeof *frame->values);
+    frame->values[frame->length++] = value;
+    frame->has_pending_key = false;
+}
+
+static bool smh_builder_begin(struct smh_builder *builder, enum smh_dict_kind kind){
+    if(builder->depth == builder->capacity){
+        builder->capacity = builder->capacity ? builder->capacity * 2 : 16;
+        builder->frames = smh_realloc(builder->frames, sizeof *builder->frames * builder->capacity);
+    }
+
+    struct smh_builder_frame *frame = &builder->frames[builder->depth++];
+    frame->kind = kind;
+    frame->values = NULL;
+    frame->keys = NULL;
+    frame->length = 0;
+    frame->values_capacity = 0;
+    frame->keys_capacity = 0;
+    frame->has_pending_key = false;
+    return true;
+}
+
+static bool smh_builder_end(void *user){
+    struct smh_builder *builder = user;
+    struct smh_builder_frame *frame = &builder->frames[--builder->depth];
+
+    if(frame->kind == SMH_DICT_OBJECT){
+        struct smh_dict object = smh_dict_object(frame->keys, frame->values, frame->length);
+
+        if(frame->length >= SMH_OBJECT_INDEX_THRESHOLD){
+            struct smh_object_index *index = smh_parser_alloc(builder->parser, smh_object_index_size(frame->length));
+            object.as_object.index = smh_object_index_fill(index, &object.as_object);
+        }
+
+        smh_builder_deliver(builder, object);
+    } else {
+        smh_builder_deliver(builder, smh_dict_array(frame->values, frame->length));
+    }
+
+    return true;
+}
+
+static bool smh_builder_begin_array(void *user){
+    return smh_builder_begin(user, SMH_DICT_ARRAY);
+}
+
+static bool smh_builder_begin_object(void *user){
+    return smh_builder_begin(user, SMH_DICT_OBJECT);
+}
+
+static bool smh_builder_key(void *user, const char *data, size_t length){
+    struct smh_builder *builder = user;
+    struct smh_builder_frame *frame = &builder->frames[builder->depth - 1];
+
+    frame->keys = smh_parser_grow(builder->parser, frame->keys, &frame->keys_capacity, frame->length + 1, sizeof *frame->keys);
+    frame->keys[frame->length] = smh_builder_string(builder, data, length, builder->parser->symbols != NULL).as_string;
+    frame->has_pending_key = true;
+    return true;
+}
+
+static bool smh_builder_string_value(void *user, const char *data, size_t length){
+    struct smh_builder *builder = user;
+    struct smh_parser *parser = builder->parser;
+    smh_builder_deliver(builder, smh_builder_string(builder, data, length, parser->symbols && length <= parser->intern_values));
+    return true;
+}
+
+static void smh_builder_create(struct smh_builder *builder, struct smh_handler *handler, struct smh_parser *parser){
+    builder->parser = parser;
+    builder->frames = NULL;
+    builder->depth = 0;
+    builder->capacity = 0;
+    builder->has_root = false;
+
+    handler->user = builder;
+    handler->begin_array = smh_builder_begin_array;
+    handler->end_array = smh_builder_end;
+    handler->begin_object = smh_builder_begin_object;
+    handler->key = smh_builder_key;
+    handler->string = smh_builder_string_value;
+    handler->end_object = smh_builder_end;
+}
+
+// Releases whatever was built before parsing failed
+static void smh_builder_discard(struct smh_builder *builder){
+    struct smh_parser *parser = builder->parser;
+
+    while(builder->depth){
+        struct smh_builder_frame *frame = &builder->frames[--builder->depth];
+
+        if(frame->kind == SMH_DICT_OBJECT){
+            smh_parser_discard_strings(parser, frame->keys, frame->length + frame->has_pending_key);
+        }
+
+        smh_parser_discard_dicts(parser, frame->values, frame->length);
+    }
+
+    if(builder->has_root){
+        smh_parser_discard(parser, &builder->root);
+        builder->has_root = false;
+    }
+}
+
+static struct smh_result smh_parser_build(struct smh_parser *parser, enum smh_errorcode (*run)(struct smh_parser*)){
+    struct smh_builder builder;
+    struct smh_handler handler;
+
+    smh_builder_create(&builder, &handler, parser);
+    parser->handler = &handler;
+
+    enum smh_errorcode errorcode = run(parser);
+    smh_parser_count(parser, bytes_scanned, parser->index);
+
+    if(errorcode){
+        smh_builder_discard(&builder);
+        smh_free(builder.frames);
+        return smh_result_failure(smh_failure(errorcode));
+    }
+
+    smh_free(builder.frames);
+
+    struct smh_result document = smh_result_success(builder.root);
+    document.arena = parser->arena;
+    return document;
+}
+
+static struct smh_result smh_parser_parse_document(struct smh_parser *parser){
+    return smh_parser_build(parser, smh_parser_run);
+}
+
+struct smh_result smh_parse(const char *markup){
+    return smh_parse_n(markup, strlen(markup));
+}
+
+struct smh_result smh_parse_arena(const char *markup, struct smh_arena *arena){
+    struct smh_options options = {0};
+    options.arena = arena;
+    return smh_parse_n_ex(markup, strlen(markup), &options);
+}
+
+struct smh_result smh_parse_ex(const char *markup, const struct smh_options *options){
+    return smh_parse_n_ex(markup, strlen(markup), options);
+}
+
+struct smh_result smh_parse_n(const char *data, size_t length){
+    struct smh_parser parser;
+    smh_parser_create(&parser, 0, data, length);
+    return smh_parser_parse_document(&parser);
+}
+
+#ifdef SMH_PARSER_THREADS
+    static bool smh_parse_parallel(const char *data, size_t length, const struct smh_options *options, struct smh_result *result);
+#endif
+
+// Documents can also be indexed up front and parsed by walking that index, but that is
+// slower than scanning the markup directly on every document measured so far, so it
+// isn't offered through smh_options
+static struct smh_result smh_parse_with(const char *data, size_t length, const struct smh_options *options, bool indexed){
+    #ifdef SMH_PARSER_THREADS
+        struct smh_result result;
+
+        // Symbol tables can't be added to from several threads at once
+        if(!indexed && options->threads > 1 && options->symbols == NULL && smh_parse_parallel(data, length, options, &result)){
+            return result;
+        }
+    #endif
+
+    struct smh_parser parser;
+    smh_parser_create(&parser, 0, data, length);
+    parser.arena = options->arena;
+    parser.borrow_strings = options->borrow_strings;
+    parser.symbols = options->symbols;
+    parser.intern_values = options->intern_values;
+    if(options->max_depth) parser.max_depth = options->max_depth;
+
+    #ifdef SMH_PARSER_STATS
+        parser.stats = options->stats;
+    #endif
+
+    if(!indexed){
+        return smh_parser_parse_document(&parser);
+    }
+
+    struct smh_index index;
+    smh_index_create(&index, data, length);
+    parser.structural_index = &index;
+
+    struct smh_result walked = smh_parser_parse_document(&parser);
+    smh_index_free(&index);
+    return walked;
+}
+
+struct smh_result smh_parse_n_ex(const char *data, size_t length, const struct smh_options *options){
+    #ifdef SMH_PARSER_STATS
+        // Tracing reports statistics even when the caller didn't ask for them
+        struct smh_stats stats;
+        struct smh_options traced = *options;
+
+        if(traced.stats == NULL && traced.trace) traced.stats = &stats;
+        if(traced.stats) memset(traced.stats, 0, sizeof *traced.stats);
+        if(traced.trace && traced.trace->begin) traced.trace->begin(traced.trace->user, data, length);
+
+        options = &traced;
+    #endif
+
+    #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+        struct smh_allocations *previous = smh_allocations_target;
+
+        if(options->allocations){
+            memset(options->allocations, 0, sizeof *options->allocations);
+            smh_allocations_target = options->allocations;
+        }
+    #endif
+
+    struct smh_result result = smh_parse_with(data, length, options, false);
+
+    #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+        smh_allocations_target = previous;
+    #endif
+
+    #ifdef SMH_PARSER_STATS
+        if(traced.trace && traced.trace->end){
+            traced.trace->end(traced.trace->user, result.ok ? SMH_ERRORCODE_NONE : result.as_failure.errorcode, traced.stats);
+        }
+    #endif
+
+    return result;
+}
+
+enum smh_errorcode smh_parse_events(const char *data, size_t length, const struct smh_handler *handler){
+    struct smh_parser parser;
+    smh_parser_create(&parser, 0, data, length);
+    parser.handler = handler;
+    return smh_parser_run(&parser);
+}
+
+enum smh_errorcode smh_validate(const char *data, size_t length){
+    static const struct smh_handler nobody = {0};
+    return smh_parse_events(data, length, &nobody);
+}
+
+// Integers are decimal with an optional sign, anything else or a value out of range is refused
+static bool smh_convert_unsigned(const char *data, size_t length, uint64_t max, uint64_t *value){
+    if(length && data[0] == '+'){
+        data++;
+        length--;
+    }
+
+    if(length == 0) return false;
+
+    uint64_t result = 0;
+
+    for(size_t i = 0; i < length; i++){
+        unsigned int digit = (unsigned char) data[i] - '0';
+
+        if(digit > 9 || result > (max - digit) / 10) return false;
+        result = result * 10 + digit;
+    }
+
+    *value = result;
+    return true;
+}
+
+static bool smh_convert_int(const char *data, size_t length, int64_t min, int64_t max, int64_t *value){
+    bool negative = length && data[0] == '-';
+    uint64_t magnitude;
+
+    if(negative){
+        if(!smh_convert_unsigned(&data[1], length - 1, (uint64_t) -(min + 1) + 1, &magnitude) || (length > 1 && data[1] == '+')) return false;
+        *value = magnitude ? -(int64_t) (magnitude - 1) - 1 : 0;
+    } else {
+        if(!smh_convert_unsigned(data, length, (uint64_t) max, &magnitude)) return false;
+        *value = (int64_t) magnitude;
+    }
+
+    return true;
+}
+
+static const double smh_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static size_t smh_digits(const char *data, size_t length, size_t i){
+    while(i < length && (unsigned char) (data[i] - '0') <= 9) i++;
+    return i;
+}
+
+static bool smh_convert_double(const char *data, size_t length, double *value){
+    size_t i = 0;
+    bool negative = length && data[0] == '-';
+    if(length && (data[0] == '-' || data[0] == '+')) i++;
+
+    size_t integer = i;
+    size_t integer_end = i = smh_digits(data, length, i);
+    size_t fraction = i;
+    size_t fraction_end = i;
+
+    if(i < length && data[i] == '.'){
+        fraction = i + 1;
+        fraction_end = i = smh_digits(data, length, fraction);
+    }
+
+    if(integer == integer_end && fraction == fraction_end) return false;
+
+    int64_t exponent = 0;
+
+    if(i < length && (data[i] == 'e' || data[i] == 'E')){
+        bool negative_exponent = ++i < length && data[i] == '-';
+        if(i < length && (data[i] == '-' || data[i] == '+')) i++;
+
+        size_t start = i;
+
+        for(; i < length && (unsigned char) (data[i] - '0') <= 9; i++){
+            // Anything this large is out of range regardless
+            if(exponent < 100000) exponent = exponent * 10 + (data[i] - '0');
+        }
+
+        if(i == start) return false;
+        if(negative_exponent) exponent = -exponent;
+    }
+
+    if(i != length) return false;
+
+    // Up to 19 significant digits fit in the mantissa
+    int64_t scale = exponent - (int64_t) (fraction_end - fraction);
+    uint64_t mantissa = 0;
+    size_t significant = 0;
+
+    for(size_t j = integer; j < fraction_end && significant <= 19; j++){
+        if(j == integer_end) j = fraction;
+        if(j == fraction_end) break;
+        if(mantissa == 0 && data[j] == '0') continue;
+
+        mantissa = mantissa * 10 + (data[j] - '0');
+        significant++;
+    }
+
+    double result;
+
+    if(significant <= 19 && mantissa <= (uint64_t) 1 << 53 && scale >= -22 && scale <= 22){
+        // Both operands are exact, so the one rounding step rounds correctly
+        result = (double) mantissa;
+        result = scale < 0 ? result / smh_powers_of_ten[-scale] : result * smh_powers_of_ten[scale];
+    } else if(significant == 0){
+        result = 0.0;
+    } else {
+        // strtod rounds correctly but reads the decimal point of the locale,
+        // so it's given only the digits followed by an exponent
+        char small[64];
+        size_t needed = (integer_end - integer) + (fraction_end - fraction) + 24;
+        char *text = needed <= sizeof small ? small : smh_malloc(needed);
+        size_t written = 0;
+
+        memcpy(text, &data[integer], integer_end - integer);
+        written += integer_end - integer;
+        memcpy(&text[written], &data[fraction], fraction_end - fraction);
+        written += fraction_end - fraction;
+        text[written++] = 'e';
+
+        if(scale < 0) text[written++] = '-';
+
+        char reversed[24];
+        size_t count = 0;
+        uint64_t magnitude = scale < 0 ? (uint64_t) -scale : (uint64_t) scale;
+
+        do {
+            reversed[count++] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while(magnitude);
+
+        while(count) text[written++] = reversed[--count];
+        text[written] = '\0';
+
+        result = strtod(text, NULL);
+        if(text != small) smh_free(text);
+    }
+
+    if(result > DBL_MAX) return false;
+
+    *value = negative ? -result : result;
+    return true;
+}
+
+static bool smh_convert_bool(const char *data, size_t length, bool *value){
+    if((length == 4 && memcmp(data, "true", 4) == 0) || (length == 3 && memcmp(data, "yes", 3) == 0)){
+        *value = true;
+        return true;
+    }
+
+    if((length == 5 && memcmp(data, "false", 5) == 0) || (length == 2 && memcmp(data, "no", 2) == 0)){
+        *value = false;
+        return true;
+    }
+
+    return false;
+}
+
+// Decoding follows the events of a parse with a stack of the maps and arrays being filled in
+struct smh_decode_frame {
+    // Field the container is the value of
+    const struct smh_field *field;
+    char *base;
+
+    // Only used for maps, the field of the last key or NULL when it has none,
+    // and where the flags of which fields were seen begin
+    const struct smh_field *pending;
+    size_t seen;
+
+    // Only used for arrays
+    size_t capacity;
+};
+
+struct smh_decoder {
+    struct smh_field root;
+    void *target;
+    bool done;
+
+    struct smh_decode_frame *frames;
+    size_t depth;
+    size_t frames_capacity;
+
+    bool *seen;
+    size_t seen_length;
+    size_t seen_capacity;
+
+    // Levels of a value that has no field
+    size_t skipping;
+
+    enum smh_errorcode errorcode;
+    const char *failed;
+};
+
+static void *smh_decoder_grow(void *pointer, size_t *capacity, size_t needed, size_t element_size){
+    if(needed <= *capacity) return pointer;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 4;
+
+    while(new_capacity < needed){
+        new_capacity *= 2;
+    }
+
+    *capacity = new_capacity;
+    return smh_realloc(pointer, new_capacity * element_size);
+}
+
+static bool smh_decoder_fail(struct smh_decoder *decoder, enum smh_errorcode errorcode, const struct smh_field *field){
+    decoder->errorcode = errorcode;
+    decoder->failed = field->name;
+    return false;
+}
+
+static void smh_field_free(const struct smh_field *field, char *base){
+    switch(field->type){
+    case SMH_FIELD_STRING: {
+            char **string = (char**) &base[field->offset];
+            smh_free(*string);
+            *string = NULL;
+        }
+        break;
+    case SMH_FIELD_OBJECT:
+        smh_schema_free(field->schema, &base[field->offset]);
+        break;
+    case SMH_FIELD_ARRAY: {
+            char **items = (char**) &base[field->offset];
+            size_t *count = (size_t*) &base[field->count_offset];
+
+            if(*items){
+                for(size_t i = 0; i < *count; i++){
+                    smh_field_free(field->element, &(*items)[i * field->element_size]);
+                }
+            }
+
+            smh_free(*items);
+            *items = NULL;
+            *count = 0;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void smh_schema_free(const struct smh_schema *schema, void *target){
+    for(size_t i = 0; i < schema->length; i++){
+        smh_field_free(&schema->fields[i], target);
+    }
+}
+
+// Finds where the next value goes, returning NULL when it has no field
+static const struct smh_field *smh_decoder_slot(struct smh_decoder *decoder, char **base){
+    if(decoder->depth == 0){
+        if(decoder->done) return NULL;
+
+        decoder->done = true;
+        *base = decoder->target;
+        return &decoder->root;
+    }
+
+    struct smh_decode_frame *frame = &decoder->frames[decoder->depth - 1];
+    const struct smh_field *field = frame->field;
+
+    if(field->type == SMH_FIELD_OBJECT){
+        *base = frame->base;
+        return frame->pending;
+    }
+
+    // New elements start out zeroed, so that their strings and arrays are NULL
+    char **items = (char**) &frame->base[field->offset];
+    size_t *count = (size_t*) &frame->base[field->count_offset];
+
+    *items = smh_decoder_grow(*items, &frame->capacity, *count + 1, field->element_size);
+    *base = &(*items)[*count * field->element_size];
+    memset(*base, 0, field->element_size);
+    (*count)++;
+    return field->element;
+}
+
+static bool smh_decoder_begin(struct smh_decoder *decoder, enum smh_field_type type){
+    char *base;
+    const struct smh_field *field = decoder->skipping ? NULL : smh_decoder_slot(decoder, &base);
+
+    if(field == NULL){
+        decoder->skipping++;
+        return true;
+    }
+
+    if(field->type != type) return smh_decoder_fail(decoder, SMH_ERRORCODE_BAD_VALUE, field);
+
+    // A repeated key replaces the array it had
+    if(type == SMH_FIELD_ARRAY) smh_field_free(field, base);
+
+    decoder->frames = smh_decoder_grow(decoder->frames, &decoder->frames_capacity, decoder->depth + 1, sizeof *decoder->frames);
+
+    struct smh_decode_frame *frame = &decoder->frames[decoder->depth++];
+    frame->field = field;
+    frame->pending = NULL;
+    frame->seen = decoder->seen_length;
+    frame->capacity = 0;
+
+    if(type == SMH_FIELD_OBJECT){
+        frame->base = &base[field->offset];
+
+        size_t fields = field->schema->length;
+        decoder->seen = smh_decoder_grow(decoder->seen, &decoder->seen_capacity, decoder->seen_length + fields, sizeof *decoder->seen);
+        memset(&decoder->seen[decoder->seen_length], 0, fields * sizeof *decoder->seen);
+        decoder->seen_length += fields;
+    } else {
+        frame->base = base;
+    }
+
+    return true;
+}
+
+static bool smh_decoder_end(void *user){
+    struct smh_decoder *decoder = user;
+
+    if(decoder->skipping){
+        decoder->skipping--;
+        return true;
+    }
+
+    struct smh_decode_frame *frame = &decoder->frames[--decoder->depth];
+
+    if(frame->field->type == SMH_FIELD_OBJECT){
+        const struct smh_schema *schema = frame->field->schema;
+
+        for(size_t i = 0; i < schema->length; i++){
+            if(schema->fields[i].required && !decoder->seen[frame->seen + i]){
+                return smh_decoder_fail(decoder, SMH_ERRORCODE_MISSING_FIELD, &schema->fields[i]);
+            }
+        }
+
+        decoder->seen_length = frame->seen;
+    }
+
+    return true;
+}
+
+static bool smh_decoder_begin_array(void *user){
+    return smh_decoder_begin(user, SMH_FIELD_ARRAY);
+}
+
+static bool smh_decoder_begin_object(void *user){
+    return smh_decoder_begin(user, SMH_FIELD_OBJECT);
+}
+
+static bool smh_decoder_key(void *user, const char *data, size_t length){
+    struct smh_decoder *decoder = user;
+    if(decoder->skipping) return true;
+
+    struct smh_decode_frame *frame = &decoder->frames[decoder->depth - 1];
+    const struct smh_schema *schema = frame->field->schema;
+    frame->pending = NULL;
+
+    // Comparing stops at the first differing byte, so unknown keys cost little
+    for(size_t i = 0; i < schema->length; i++){
+        const char *name = schema->fields[i].name;
+
+        if(strncmp(name, data, length) == 0 && name[length] == '\0'){
+            frame->pending = &schema->fields[i];
+            decoder->seen[frame->seen + i] = true;
+            break;
+        }
+    }
+
+    return true;
+}
+
+static bool smh_decoder_string(void *user, const char *data, size_t length){
+    struct smh_decoder *decoder = user;
+    if(decoder->skipping) return true;
+
+    char *base;
+    const struct smh_field *field = smh_decoder_slot(decoder, &base);
+    if(field == NULL) return true;
+
+    void *value = &base[field->offset];
+    int64_t integer;
+    uint64_t size;
+    bool converted;
+
+    switch(field->type){
+    case SMH_FIELD_STRING: {
+            char *string = smh_malloc(length + 1);
+            memcpy(string, data, length);
+            string[length] = '\0';
+
+            smh_free(*(char**) value);
+            *(char**) value = string;
+            converted = true;
+        }
+        break;
+    case SMH_FIELD_BOOL:
+        converted = smh_convert_bool(data, length, value);
+        break;
+    case SMH_FIELD_INT:
+        converted = smh_convert_int(data, length, INT_MIN, INT_MAX, &integer);
+        if(converted) *(int*) value = (int) integer;
+        break;
+    case SMH_FIELD_INT64:
+        converted = smh_convert_int(data, length, INT64_MIN, INT64_MAX, &integer);
+        if(converted) *(int64_t*) value = integer;
+        break;
+    case SMH_FIELD_SIZE:
+        converted = smh_convert_unsigned(data, length, SIZE_MAX, &size);
+        if(converted) *(size_t*) value = (size_t) size;
+        break;
+    case SMH_FIELD_DOUBLE:
+        converted = smh_convert_double(data, length, value);
+        break;
+    default:
+        converted = false;
+    }
+
+    return converted || smh_decoder_fail(decoder, SMH_ERRORCODE_BAD_VALUE, field);
+}
+
+enum smh_errorcode smh_decode(const char *data, size_t length, const struct smh_schema *schema, void *target, const char **field){
+    struct smh_decoder decoder = {
+        .root = { .type = SMH_FIELD_OBJECT, .schema = schema },
+        .target = target,
+    };
+
+    struct smh_handler handler = {
+        .user = &decoder,
+        .begin_array = smh_decoder_begin_array,
+        .end_array = smh_decoder_end,
+        .begin_object = smh_decoder_begin_object,
+        .key = smh_decoder_key,
+        .string = smh_decoder_string,
+        .end_object = smh_decoder_end,
+    };
+
+    enum smh_errorcode errorcode = smh_parse_events(data, length, &handler);
+    if(errorcode == SMH_ERRORCODE_ABORTED) errorcode = decoder.errorcode;
+
+    smh_free(decoder.frames);
+    smh_free(decoder.seen);
+
+    if(errorcode){
+        smh_schema_free(schema, target);
+    }
+
+    if(field) *field = decoder.failed;
+    return errorcode;
+}
+
+// Numbers followed by a unit, one after another like 1h30m
+static bool smh_convert_duration(const char *data, size_t length, double *seconds){
+    static const struct {
+        const char *name;
+        double seconds;
+    } units[] = {
+        {"ns", 1e-9}, {"us", 1e-6}, {"ms", 1e-3}, {"s", 1}, {"m", 60}, {"h", 3600}, {"d", 86400},
+    };
+
+    if(length == 1 && data[0] == '0'){
+        *seconds = 0;
+        return true;
+    }
+
+    bool negative = length && data[0] == '-';
+    size_t i = negative;
+    double total = 0;
+
+    if(i == length) return false;
+
+    while(i < length){
+        size_t number = i;
+        i = smh_digits(data, length, i);
+        if(i < length && data[i] == '.') i = smh_digits(data, length, i + 1);
+
+        size_t unit = i;
+        while(i < length && ((data[i] >= 'a' && data[i] <= 'z'))) i++;
+
+        double amount;
+        if(!smh_convert_double(&data[number], unit - number, &amount)) return false;
+
+        size_t u = 0;
+        size_t count = sizeof units / sizeof *units;
+
+        while(u < count && !(strlen(units[u].name) == i - unit && memcmp(units[u].name, &data[unit], i - unit) == 0)){
+            u++;
+        }
+
+        if(u == count) return false;
+        total += amount * units[u].seconds;
+    }
+
+    if(total > DBL_MAX) return false;
+
+    *seconds = negative ? -total : total;
+    return true;
+}
+
+static bool smh_convert_size(const char *data, size_t length, uint64_t *bytes){
+    size_t end = smh_digits(data, length, 0);
+    unsigned int shift = 0;
+    uint64_t value;
+
+    if(!smh_convert_unsigned(data, end, UINT64_MAX, &value)) return false;
+
+    if(end < length){
+        switch(data[end]){
+        case 'K': case 'k': shift = 10; break;
+        case 'M': case 'm': shift = 20; break;
+        case 'G': case 'g': shift = 30; break;
+        case 'T': case 't': shift = 40; break;
+        }
+
+        if(shift) end++;
+    }
+
+    size_t rest = length - end;
+    const char *suffix = &data[end];
+
+    if(!(rest == 0 || (rest == 1 && suffix[0] == 'B') || (shift && rest == 2 && memcmp(suffix, "iB", 2) == 0))){
+        return false;
+    }
+
+    if(value > UINT64_MAX >> shift) return false;
+
+    *bytes = value << shift;
+    return true;
+}
+
+static bool smh_convert_scalar(const char *data, size_t length, enum smh_scalar_kind kind, union smh_scalar *value){
+    switch(kind){
+    case SMH_SCALAR_INT:
+        return smh_convert_int(data, length, INT64_MIN, INT64_MAX, &value->as_int);
+    case SMH_SCALAR_FLOAT:
+        return smh_convert_double(data, length, &value->as_float);
+    case SMH_SCALAR_BOOL:
+        return smh_convert_bool(data, length, &value->as_bool);
+    case SMH_SCALAR_DURATION:
+        return smh_convert_duration(data, length, &value->as_duration);
+    case SMH_SCALAR_SIZE:
+        return smh_convert_size(data, length, &value->as_size);
+    default:
+        return false;
+    }
+}
+
+static bool smh_dict_read(const struct smh_dict *dict, enum smh_scalar_kind kind, union smh_scalar *value){
+    // Nothing is cached as any other kind, so neither is looked up
+    if(kind < SMH_SCALAR_INT || kind > SMH_SCALAR_SIZE || dict->kind != SMH_DICT_STRING) return false;
+
+    if(dict->cached == kind){
+        *value = dict->as_cached.value;
+        return true;
+    }
+
+    return smh_convert_scalar(dict->as_string.cstr, dict->as_string.length, kind, value);
+}
+
+bool smh_dict_int(const struct smh_dict *dict, int64_t *value){
+    union smh_scalar scalar;
+    if(!smh_dict_read(dict, SMH_SCALAR_INT, &scalar)) return false;
+
+    *value = scalar.as_int;
+    return true;
+}
+
+bool smh_dict_float(const struct smh_dict *dict, double *value){
+    union smh_scalar scalar;
+    if(!smh_dict_read(dict, SMH_SCALAR_FLOAT, &scalar)) return false;
+
+    *value = scalar.as_float;
+    return true;
+}
+
+bool smh_dict_bool(const struct smh_dict *dict, bool *value){
+    union smh_scalar scalar;
+    if(!smh_dict_read(dict, SMH_SCALAR_BOOL, &scalar)) return false;
+
+    *value = scalar.as_bool;
+    return true;
+}
+
+bool smh_dict_duration(const struct smh_dict *dict, double *seconds){
+    union smh_scalar scalar;
+    if(!smh_dict_read(dict, SMH_SCALAR_DURATION, &scalar)) return false;
+
+    *seconds = scalar.as_duration;
+    return true;
+}
+
+bool smh_dict_size(const struct smh_dict *dict, uint64_t *bytes){
+    union smh_scalar scalar;
+    if(!smh_dict_read(dict, SMH_SCALAR_SIZE, &scalar)) return false;
+
+    *bytes = scalar.as_size;
+    return true;
+}
+
+bool smh_dict_scalar(struct smh_dict *dict, enum smh_scalar_kind kind, union smh_scalar *value){
+    if(!smh_dict_read(dict, kind, value)) return false;
+
+    dict->cached = kind;
+    dict->as_cached.value = *value;
+    return true;
+}
+
+// Items of an array tend to share a layout, so the key is looked for where it was in the last item first
+static const struct smh_dict *smh_array_column(const struct smh_array *array, size_t i, const struct smh_key *key, size_t *hint){
+    const struct smh_dict *item = &array->items[i];
+    if(key == NULL) return item;
+    if(item->kind != SMH_DICT_OBJECT) return NULL;
+
+    const struct smh_object *object = &item->as_object;
+
+    if(*hint < object->length && smh_key_matches(&object->keys[*hint], key)){
+        return &object->values[*hint];
+    }
+
+    const struct smh_dict *value = smh_object_get_key(object, key);
+    if(value) *hint = value - object->values;
+    return value;
+}
+
+size_t smh_array_ints(const struct smh_array *array, const struct smh_key *key, int64_t *values){
+    size_t hint = 0;
+
+    for(size_t i = 0; i < array->length; i++){
+        const struct smh_dict *dict = smh_array_column(array, i, key, &hint);
+        if(dict == NULL || !smh_dict_int(dict, &values[i])) return i;
+    }
+
+    return array->length;
+}
+
+size_t smh_array_floats(const struct smh_array *array, const struct smh_key *key, double *values){
+    size_t hint = 0;
+
+    for(size_t i = 0; i < array->length; i++){
+        const struct smh_dict *dict = smh_array_column(array, i, key, &hint);
+        if(dict == NULL || !smh_dict_float(dict, &values[i])) return i;
+    }
+
+    return array->length;
+}
+
+// Documents whose top level is a bullet array or map can be cut into regions
+// at the lines that begin its entries, and each region parsed on its own
+
+enum smh_split_mode {
+    SMH_SPLIT_UNDECIDED,
+    SMH_SPLIT_BULLETS,
+    SMH_SPLIT_MAP,
+    SMH_SPLIT_WHOLE,
+};
+
+struct smh_split {
+    enum smh_split_mode mode;
+    size_t level;
+
+    // Where the first entry begins
+    size_t content;
+};
+
+// Determines the kind of document from its first line, the same way smh_parser_parse does
+static struct smh_split smh_split_detect(const char *data, size_t length, bool last){
+    struct smh_split split;
+    split.mode = SMH_SPLIT_UNDECIDED;
+    split.level = 0;
+    split.content = 0;
+
+    size_t i = 0;
+
+    while(i < length && data[i] == '\n') i++;
+
+    size_t indentation = i;
+
+    while(i < length && data[i] == ' ') i++;
+
+    if(i + 1 >= length){
+        // Not enough to tell yet
+    } else if(data[i] == '-' && data[i + 1] == ' '){
+        split.mode = SMH_SPLIT_BULLETS;
+    } else if(data[i] == '"' || data[i] == '[' || data[i] == '\t' || data[i] == '\n'){
+        split.mode = SMH_SPLIT_WHOLE;
+    } else {
+        size_t end = smh_scan(data, i, length, "\n:");
+
+        if(end < length){
+            split.mode = data[end] == ':' ? SMH_SPLIT_MAP : SMH_SPLIT_WHOLE;
+        }
+    }
+
+    if(split.mode == SMH_SPLIT_UNDECIDED){
+        if(last) split.mode = SMH_SPLIT_WHOLE;
+        return split;
+    }
+
+    split.level = (i - indentation) / 2;
+    split.content = i;
+    return split;
+}
+
+// Whether the line at 'line' could begin the next top-level entry, or -1 if that isn't known yet
+static int smh_split_is_boundary(const struct smh_split *split, const char *data, size_t length, size_t line){
+    size_t i = line;
+
+    while(i < length && data[i] == ' ') i++;
+
+    if(i + 1 >= length) return -1;
+    if((i - line) / 2 != split->level) return 0;
+
+    bool bullet = data[i] == '-' && data[i + 1] == ' ';
+
+    if(split->mode == SMH_SPLIT_BULLETS) return bullet;
+    if(bullet || data[i] == '\n') return 0;
+
+    size_t end = smh_scan(data, i, length, "\n:");
+    if(end >= length) return -1;
+    return data[end] == ':';
+}
+
+static void smh_parser_create_region(struct smh_parser *parser, const struct smh_split *split, const char *data, size_t length){
+    smh_parser_create(parser, 0, data, length);
+    parser->region_kind = split->mode == SMH_SPLIT_BULLETS ? SMH_DICT_ARRAY : SMH_DICT_OBJECT;
+    parser->region_level = split->level;
+}
+
+#ifdef SMH_PARSER_THREADS
+    // Threads parse adjacent regions speculatively, the whole document is parsed
+    // again on one thread if any region turns out not to stand on its own
+
+    // Finds the next line after 'from' that could begin an entry, and returns
+    // the position of the newline before it, or 'length' if there isn't one
+    static size_t smh_split_find(const struct smh_split *split, const char *data, size_t length, size_t from){
+        for(;;){
+            const char *newline = memchr(&data[from], '\n', length - from);
+            if(newline == NULL) return length;
+
+            size_t end = newline - data;
+            if(smh_split_is_boundary(split, data, length, end + 1) > 0) return end;
+
+            from = end + 1;
+        }
+    }
+
+    #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+        // Adds what another thread counted, as if its peak was reached on top of what's in use here
+        static void smh_allocations_merge(struct smh_allocations *allocations, const struct smh_allocations *other){
+            allocations->allocations += other->allocations;
+            allocations->reallocations += other->reallocations;
+            allocations->frees += other->frees;
+            allocations->bytes += other->bytes;
+
+            if(allocations->current + other->peak > allocations->peak){
+                allocations->peak = allocations->current + other->peak;
+            }
+
+            allocations->current += other->current;
+        }
+    #endif
+
+    #ifdef SMH_PARSER_STATS
+        static void smh_stats_merge(struct smh_stats *stats, const struct smh_stats *other, bool nodes){
+            stats->bytes_scanned += other->bytes_scanned;
+            stats->bytes_copied += other->bytes_copied;
+            stats->rewinds += other->rewinds;
+
+            for(size_t i = 0; nodes && i <= SMH_DICT_OBJECT; i++){
+                stats->nodes[i] += other->nodes[i];
+            }
+
+            if(other->max_depth > stats->max_depth) stats->max_depth = other->max_depth;
+        }
+    #endif
+
+    struct smh_worker {
+        const struct smh_split *split;
+        const struct smh_options *options;
+        const char *data;
+        size_t length;
+        bool last;
+        struct smh_arena arena;
+        struct smh_result result;
+        bool complete;
+
+        #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+            bool counting;
+            struct smh_allocations allocations;
+        #endif
+
+        #ifdef SMH_PARSER_STATS
+            struct smh_stats stats;
+        #endif
+    };
+
+    static void *smh_worker_run(void *user){
+        struct smh_worker *worker = user;
+        struct smh_parser parser;
+
+        #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+            struct smh_allocations *previous = smh_allocations_target;
+            smh_allocations_target = worker->counting ? &worker->allocations : NULL;
+        #endif
+
+        smh_parser_create_region(&parser, worker->split, worker->data, worker->length);
+        parser.arena = worker->options->arena ? &worker->arena : NULL;
+        parser.borrow_strings = worker->options->borrow_strings;
+        if(worker->options->max_depth) parser.max_depth = worker->options->max_depth;
+
+        #ifdef SMH_PARSER_STATS
+            parser.stats = worker->options->stats ? &worker->stats : NULL;
+        #endif
+
+        worker->result = smh_parser_build(&parser, smh_parser_run_region);
+        worker->complete = worker->result.ok && smh_parser_region_is_complete(&parser, worker->last);
+
+        #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+            smh_allocations_target = previous;
+        #endif
+
+        return NULL;
+    }
+
+    // Moves every block of 'from' into 'arena' ahead of its current block
+    static void smh_arena_splice(struct smh_arena *arena, struct smh_arena *from){
+        if(from->first == NULL) return;
+
+        struct smh_arena_block *last = from->first;
+
+        while(last->next){
+            last = last->next;
+        }
+
+        if(arena->current == NULL){
+            arena->first = from->first;
+            arena->current = last;
+        } else if(arena->first == arena->current){
+            last->next = arena->current;
+            arena->first = from->first;
+        } else {
+            struct smh_arena_block *previous = arena->first;
+
+            while(previous->next != arena->current){
+                previous = previous->next;
+            }
+
+            last->next = arena->current;
+            previous->next = from->first;
+        }
+
+        from->first = NULL;
+        from->current = NULL;
+    }
+
+    static void *smh_parallel_alloc(struct smh_arena *arena, size_t size){
+        if(size == 0) size = 1;
+        return arena ? smh_arena_alloc(arena, size) : smh_malloc(size);
+    }
+
+    // Joins the top-level containers of every region into one
+    static struct smh_dict smh_parallel_join(struct smh_worker *workers, size_t count, struct smh_arena *arena){
+        size_t length = 0;
+
+        for(size_t i = 0; i < count; i++){
+            struct smh_dict *root = &workers[i].result.as_success;
+            length += root->kind == SMH_DICT_ARRAY ? root->as_array.length : root->as_object.length;
+        }
+
+        if(workers[0].result.as_success.kind == SMH_DICT_ARRAY){
+            struct smh_dict *items = smh_parallel_alloc(arena, sizeof *items * length);
+            size_t position = 0;
+
+            for(size_t i = 0; i < count; i++){
+                struct smh_array *array = &workers[i].result.as_success.as_array;
+                if(array->length) memcpy(&items[position], array->items, sizeof *items * array->length);
+                position += array->length;
+
+                if(!arena) smh_free(array->items);
+            }
+
+            return smh_dict_array(items, length);
+        }
+
+        struct smh_string *keys = smh_parallel_alloc(arena, sizeof *keys * length);
+        struct smh_dict *values = smh_parallel_alloc(arena, sizeof *values * length);
+        size_t position = 0;
+
+        for(size_t i = 0; i < count; i++){
+            struct smh_object *object = &workers[i].result.as_success.as_object;
+
+            if(object->length){
+                memcpy(&keys[position], object->keys, sizeof *keys * object->length);
+                memcpy(&values[position], object->values, sizeof *values * object->length);
+            }
+
+            position += object->length;
+
+            if(!arena){
+                smh_free(object->keys);
+                smh_free(object->values);
+                smh_free(object->index);
+            }
+        }
+
+        struct smh_dict object = smh_dict_object(keys, values, length);
+
+        if(length >= SMH_OBJECT_INDEX_THRESHOLD){
+            struct smh_object_index *index = smh_parallel_alloc(arena, smh_object_index_size(length));
+            object.as_object.index = smh_object_index_fill(index, &object.as_object);
+        }
+
+        return object;
+    }
+
+    static bool smh_parse_parallel(const char *data, size_t length, const struct smh_options *options, struct smh_result *result){
+        size_t threads = options->threads;
+
+        if(threads > length / SMH_PARSER_THREAD_MIN_LENGTH){
+            threads = length / SMH_PARSER_THREAD_MIN_LENGTH;
+        }
+
+        if(threads < 2) return false;
+
+        struct smh_split split = smh_split_detect(data, length, true);
+        if(split.mode != SMH_SPLIT_BULLETS && split.mode != SMH_SPLIT_MAP) return false;
+
+        // Cut at the first entry after each even share of the markup
+        struct smh_worker *workers = smh_malloc(sizeof *workers * threads);
+        size_t count = 0;
+        size_t start = 0;
+
+        while(count < threads){
+            size_t target = length / threads * (count + 1);
+            size_t from = start ? start : split.content;
+            size_t end = count + 1 == threads ? length : smh_split_find(&split, data, length, target > from ? target : from);
+
+            struct smh_worker *worker = &workers[count++];
+            worker->split = &split;
+            worker->options = options;
+            worker->data = &data[start];
+            worker->length = end - start;
+            worker->last = end == length;
+
+            #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+                worker->counting = smh_allocations_target != NULL;
+                memset(&worker->allocations, 0, sizeof worker->allocations);
+            #endif
+
+            #ifdef SMH_PARSER_STATS
+                memset(&worker->stats, 0, sizeof worker->stats);
+            #endif
+
+            if(options->arena){
+                smh_arena_create(&worker->arena, options->arena->block_size);
+            }
+
+            if(worker->last) break;
+            start = end + 1;
+        }
+
+        pthread_t *handles = smh_malloc(sizeof *handles * count);
+        bool *started = smh_malloc(sizeof *started * count);
+
+        for(size_t i = 1; i < count; i++){
+            started[i] = pthread_create(&handles[i], NULL, smh_worker_run, &workers[i]) == 0;
+            if(!started[i]) smh_worker_run(&workers[i]);
+        }
+
+        smh_worker_run(&workers[0]);
+
+        bool complete = true;
+
+        for(size_t i = 0; i < count; i++){
+            if(i && started[i]) pthread_join(handles[i], NULL);
+            complete = complete && workers[i].complete;
+
+            #ifdef SMH_PARSER_COUNT_ALLOCATIONS
+                if(workers[i].counting) smh_allocations_merge(smh_allocations_target, &workers[i].allocations);
+            #endif
+        }
+
+        #ifdef SMH_PARSER_STATS
+            // Nodes only count when they make it into the document, where the regions share one root
+            for(size_t i = 0; options->stats && i < count; i++){
+                smh_stats_merge(options->stats, &workers[i].stats, complete);
+                if(complete && i) options->stats->nodes[workers[i].result.as_success.kind]--;
+            }
+        #endif
+
+        smh_free(handles);
+        smh_free(started);
+
+        if(complete){
+            if(options->arena){
+                for(size_t i = 0; i < count; i++){
+                    smh_arena_splice(options->arena, &workers[i].arena);
+                }
+            }
+
+            *result = smh_result_success(smh_parallel_join(workers, count, options->arena));
+            result->arena = options->arena;
+        } else {
+            for(size_t i = 0; i < count; i++){
+                if(options->arena){
+                    smh_arena_free(&workers[i].arena);
+                } else {
+                    smh_result_free(&workers[i].result);
+                }
+            }
+        }
+
+        smh_free(workers);
+        return complete;
+    }
+#endif // SMH_PARSER_THREADS
+
+struct smh_push_parser {
+    bool (*item)(void *user, const struct smh_string *key, struct smh_dict *value);
+    void *user;
+
+    // Markup that hasn't been handed over yet begins at 'start'
+    char *buffer;
+    size_t start;
+    size_t length;
+    size_t capacity;
+
+    struct smh_split split;
+
+    // Where to continue looking for the end of the current entry
+    size_t scan;
+
+    // Entries that can't be parsed yet, because a string or bracket array spans lines that look like
+    // the start of another entry, are tried again once they're at least this long. It doubles with
+    // every try, so that markup isn't parsed over and over as the entries go on
+    size_t retry;
+
+    enum smh_errorcode errorcode;
+    struct smh_arena arena;
+};
+
+struct smh_push_parser *smh_push_parser_create(bool (*item)(void *user, const struct smh_string *key, struct smh_dict *value), void *user){
+    struct smh_push_parser *push = smh_malloc(sizeof *push);
+    push->item = item;
+    push->user = user;
+    push->buffer = NULL;
+    push->start = 0;
+    push->length = 0;
+    push->capacity = 0;
+    push->split = smh_split_detect("", 0, false);
+    push->scan = 0;
+    push->retry = 0;
+    push->errorcode = SMH_ERRORCODE_NONE;
+    smh_arena_create(&push->arena, 0);
+    return push;
+}
+
+void smh_push_parser_free(struct smh_push_parser *push){
+    smh_arena_free(&push->arena);
+    smh_free(push->buffer);
+    smh_free(push);
+}
+
+static void smh_push_parser_decide(struct smh_push_parser *push, bool last){
+    push->split = smh_split_detect(push->buffer, push->length, last);
+    push->scan = push->split.content;
+}
+
+static bool smh_push_parser_deliver(struct smh_push_parser *push, struct smh_dict *root){
+    switch(root->kind){
+    case SMH_DICT_ARRAY:
+        for(size_t i = 0; i < root->as_array.length; i++){
+            if(!push->item(push->user, NULL, &root->as_array.items[i])) return false;
+        }
+        return true;
+    case SMH_DICT_OBJECT:
+        for(size_t i = 0; i < root->as_object.length; i++){
+            if(!push->item(push->user, &root->as_object.keys[i], &root->as_object.values[i])) return false;
+        }
+        return true;
+    default:
+        return push->item(push->user, NULL, root);
+    }
+}
+
+// Parses and hands over the entries up until 'end', unless they might continue past it
+static enum smh_errorcode smh_push_parser_region(struct smh_push_parser *push, size_t end, bool last, bool *done){
+    struct smh_parser parser;
+    smh_parser_create_region(&parser, &push->split, &push->buffer[push->start], end - push->start);
+    parser.arena = &push->arena;
+
+    struct smh_result result = smh_parser_build(&parser, smh_parser_run_region);
+    enum smh_errorcode errorcode = SMH_ERRORCODE_NONE;
+    *done = false;
+
+    if(!result.ok){
+        // Strings and bracket arrays cut off by the end of the region continue in the next one
+        if(last || result.as_failure.errorcode != SMH_ERRORCODE_UNTERMINATED){
+            errorcode = result.as_failure.errorcode;
+        }
+    } else if(smh_parser_region_is_complete(&parser, last)){
+        *done = true;
+
+        if(!smh_push_parser_deliver(push, &result.as_success)){
+            errorcode = SMH_ERRORCODE_ABORTED;
+        }
+    } else if(last){
+        errorcode = SMH_ERRORCODE_UNABLE_TO_PARSE;
+    }
+
+    smh_arena_reset(&push->arena);
+    return errorcode;
+}
+
+static enum smh_errorcode smh_push_parser_split(struct smh_push_parser *push){
+    for(;;){
+        const char *newline = memchr(&push->buffer[push->scan], '\n', push->length - push->scan);
+        if(newline == NULL) break;
+
+        size_t end = newline - push->buffer;
+        int boundary = smh_split_is_boundary(&push->split, push->buffer, push->length, end + 1);
+
+        if(boundary < 0){
+            push->scan = end;
+            return SMH_ERRORCODE_NONE;
+        }
+
+        push->scan = end + 1;
+
+        if(boundary && end - push->start >= push->retry){
+            bool done;
+            enum smh_errorcode errorcode = smh_push_parser_region(push, end, false, &done);
+            if(errorcode) return errorcode;
+
+            if(done){
+                push->start = end + 1;
+                push->retry = 0;
+            } else {
+                push->retry = 2 * (end - push->start);
+            }
+        }
+    }
+
+    push->scan = push->length;
+    return SMH_ERRORCODE_NONE;
+}
+
+enum smh_errorcode smh_push_parser_feed(struct smh_push_parser *push, const char *chunk, size_t length){
+    if(push->errorcode) return push->errorcode;
+
+    // Drop everything that has already been handed over
+    if(push->start){
+        memmove(push->buffer, &push->buffer[push->start], push->length - push->start);
+        push->length -= push->start;
+        push->scan -= push->start;
+        push->start = 0;
+    }
+
+    if(push->length + length > push->capacity){
+        while(push->length + length > push->capacity){
+            push->capacity = push->capacity ? push->capacity * 2 : 4096;
+        }
+
+        push->buffer = smh_realloc(push->buffer, push->capacity);
+    }
+
+    if(length) memcpy(&push->buffer[push->length], chunk, length);
+    push->length += length;
+
+    if(push->split.mode == SMH_SPLIT_UNDECIDED){
+        smh_push_parser_decide(push, false);
+    }
+
+    if(push->split.mode == SMH_SPLIT_BULLETS || push->split.mode == SMH_SPLIT_MAP){
+        push->errorcode = smh_push_parser_split(push);
+    }
+
+    return push->errorcode;
+}
+
+enum smh_errorcode smh_push_parser_finish(struct smh_push_parser *push){
+    enum smh_errorcode errorcode = push->errorcode;
+
+    if(errorcode == SMH_ERRORCODE_NONE){
+        if(push->split.mode == SMH_SPLIT_UNDECIDED){
+            smh_push_parser_decide(push, true);
+        }
+
+        if(push->split.mode == SMH_SPLIT_WHOLE){
+            struct smh_options options = {0};
+            options.arena = &push->arena;
+
+            struct smh_result result = smh_parse_n_ex(push->buffer ? push->buffer : "", push->length, &options);
+
+            if(!result.ok){
+                errorcode = result.as_failure.errorcode;
+            } else if(!smh_push_parser_deliver(push, &result.as_success)){
+                errorcode = SMH_ERRORCODE_ABORTED;
+            }
+
+            smh_arena_reset(&push->arena);
+        } else {
+            bool done;
+            errorcode = smh_push_parser_region(push, push->length, true, &done);
+        }
+    }
+
+    push->start = 0;
+    push->length = 0;
+    push->split = smh_split_detect("", 0, false);
+    push->scan = 0;
+    push->retry = 0;
+    push->errorcode = SMH_ERRORCODE_NONE;
+    return errorcode;
+}
+
+// Runs of whole top-level entries that parse on their own
+struct smh_document_chunk {
+    size_t start;
+    size_t entry;
+};
+
+struct smh_document {
+    // The markup has a gap where it was last edited, so that edits nearby don't move the rest of it
+    char *markup;
+    size_t length;
+    size_t capacity;
+    size_t gap;
+
+    struct smh_split split;
+    struct smh_dict root;
+    size_t root_capacity;
+
+    // Chunks cover the markup from the beginning, they are unused when it is parsed whole
+    struct smh_document_chunk *chunks;
+    size_t chunks_length;
+    size_t chunks_capacity;
+
+    // Chunks from 'shifted' on haven't been moved along with the edits before them yet
+    size_t shifted;
+    size_t shift_start;
+    size_t shift_entry;
+
+    enum smh_errorcode errorcode;
+};
+
+// Entries parsed from part of the markup, waiting to replace the old ones
+struct smh_document_patch {
+    struct smh_document_chunk *chunks;
+    size_t chunks_length;
+    size_t chunks_capacity;
+
+    struct smh_string *keys;
+    struct smh_dict *values;
+    size_t length;
+    size_t capacity;
+};
+
+static size_t smh_document_entries(const struct smh_dict *root){
+    return root->kind == SMH_DICT_ARRAY ? root->as_array.length : root->as_object.length;
+}
+
+static size_t smh_document_start(const struct smh_document *document, size_t chunk){
+    return document->chunks[chunk].start + (chunk >= document->shifted ? document->shift_start : 0);
+}
+
+// Index of the first entry of a chunk, or the number of entries for the end
+static size_t smh_document_entry(const struct smh_document *document, size_t chunk){
+    if(chunk == document->chunks_length) return smh_document_entries(&document->root);
+    return document->chunks[chunk].entry + (chunk >= document->shifted ? document->shift_entry : 0);
+}
+
+// Moves where the pending shift begins, only touching the chunks in between
+static void smh_document_move_shift(struct smh_document *document, size_t chunk){
+    while(document->shifted < chunk){
+        document->chunks[document->shifted].start += document->shift_start;
+        document->chunks[document->shifted].entry += document->shift_entry;
+        document->shifted++;
+    }
+
+    while(document->shifted > chunk){
+        document->shifted--;
+        document->chunks[document->shifted].start -= document->shift_start;
+        document->chunks[document->shifted].entry -= document->shift_entry;
+    }
+}
+
+static void smh_document_move_gap(struct smh_document *document, size_t position){
+    char *markup = document->markup;
+    size_t size = document->capacity - document->length;
+
+    if(position == document->gap){
+        return;
+    } else if(position < document->gap){
+        memmove(&markup[position + size], &markup[position], document->gap - position);
+    } else {
+        memmove(&markup[document->gap], &markup[document->gap + size], position - document->gap);
+    }
+
+    document->gap = position;
+}
+
+// Moves the gap past the end of the line at 'position', so everything before is in one piece
+static void smh_document_expose(struct smh_document *document, size_t position){
+    size_t size = document->capacity - document->length;
+    size_t end = document->length;
+
+    if(position < document->gap) position = document->gap;
+
+    if(position < end){
+        const char *newline = memchr(&document->markup[position + size], '\n', end - position);
+        if(newline) end = newline - document->markup - size + 1;
+    }
+
+    smh_document_move_gap(document, end);
+}
+
+// Changes the markup at the gap, which is left just after the inserted text
+static void smh_document_replace(struct smh_document *document, size_t offset, size_t removed, const char *text, size_t length){
+    smh_document_move_gap(document, offset);
+    document->length -= removed;
+
+    if(document->length + length >= document->capacity){
+        size_t tail = document->length - document->gap;
+        size_t old_capacity = document->capacity;
+
+        while(document->length + length >= document->capacity){
+            document->capacity = document->capacity ? document->capacity * 2 : 4096;
+        }
+
+        document->markup = smh_realloc(document->markup, document->capacity);
+        memmove(&document->markup[document->capacity - tail], &document->markup[old_capacity - tail], tail);
+    }
+
+    if(length) memcpy(&document->markup[document->gap], text, length);
+    document->gap += length;
+    document->length += length;
+}
+
+// Takes over the entries of a parsed region
+static void smh_document_patch_add(struct smh_document_patch *patch, size_t start, struct smh_dict *region){
+    bool object = region->kind == SMH_DICT_OBJECT;
+    size_t count = smh_document_entries(region);
+
+    if(patch->chunks_length == patch->chunks_capacity){
+        patch->chunks_capacity = patch->chunks_capacity ? patch->chunks_capacity * 2 : 8;
+        patch->chunks = smh_realloc(patch->chunks, sizeof *patch->chunks * patch->chunks_capacity);
+    }
+
+    patch->chunks[patch->chunks_length].start = start;
+    patch->chunks[patch->chunks_length].entry = patch->length;
+    patch->chunks_length++;
+
+    if(patch->length + count > patch->capacity){
+        while(patch->length + count > patch->capacity){
+            patch->capacity = patch->capacity ? patch->capacity * 2 : 8;
+        }
+
+        patch->values = smh_realloc(patch->values, sizeof *patch->values * patch->capacity);
+        if(object) patch->keys = smh_realloc(patch->keys, sizeof *patch->keys * patch->capacity);
+    }
+
+    if(object){
+        memcpy(&patch->keys[patch->length], region->as_object.keys, sizeof *patch->keys * count);
+        memcpy(&patch->values[patch->length], region->as_object.values, sizeof *patch->values * count);
+        smh_free(region->as_object.keys);
+        smh_free(region->as_object.values);
+        smh_free(region->as_object.index);
+    } else {
+        memcpy(&patch->values[patch->length], region->as_array.items, sizeof *patch->values * count);
+        smh_free(region->as_array.items);
+    }
+
+    patch->length += count;
+}
+
+static void smh_document_patch_free(struct smh_document_patch *patch){
+    for(size_t i = 0; i < patch->length; i++){
+        if(patch->keys) smh_string_free(&patch->keys[i]);
+        smh_dict_free(&patch->values[i]);
+    }
+
+    smh_free(patch->chunks);
+    smh_free(patch->keys);
+    smh_free(patch->values);
+}
+
+// Parses chunks from 'start' until one ends right where old chunk '*next' begins, or the markup ends.
+// Old chunks from '*next' on must already be in new positions, and those covered are skipped over
+static enum smh_errorcode smh_document_parse(struct smh_document *document, size_t start, size_t *next, struct smh_document_patch *patch){
+    // The first chunk may begin with blank lines, which don't end it
+    size_t scan = start ? start : document->split.content;
+
+    for(;;){
+        // Regions end before the next line that could begin an entry, or at the end of the markup
+        size_t end = document->length;
+        bool last = true;
+
+        for(;;){
+            // Only the markup before the gap is scanned, the gap is moved out of the way if that isn't enough
+            const char *markup = document->markup;
+            size_t length = document->gap;
+            bool whole = length == document->length;
+            const char *newline = scan < length ? memchr(&markup[scan], '\n', length - scan) : NULL;
+
+            if(newline == NULL){
+                if(whole) break;
+                smh_document_move_gap(document, document->length);
+                continue;
+            }
+
+            int boundary = smh_split_is_boundary(&document->split, markup, length, newline - markup + 1);
+
+            if(boundary < 0 && !whole){
+                smh_document_move_gap(document, document->length);
+                continue;
+            }
+
+            scan = newline - markup + 1;
+
+            if(boundary > 0){
+                end = scan - 1;
+                last = false;
+                break;
+            }
+        }
+
+        if(last) scan = document->length;
+
+        while(*next < document->chunks_length && smh_document_start(document, *next) <= end){
+            (*next)++;
+        }
+
+        struct smh_parser parser;
+        smh_parser_create_region(&parser, &document->split, &document->markup[start], end - start);
+
+        struct smh_result result = smh_parser_build(&parser, smh_parser_run_region);
+
+        if(!result.ok){
+            // Strings and bracket arrays cut off by the end of the region may continue in the next one
+            if(last || result.as_failure.errorcode != SMH_ERRORCODE_UNTERMINATED) return result.as_failure.errorcode;
+            continue;
+        }
+
+        if(!smh_parser_region_is_complete(&parser, last)){
+            smh_result_free(&result);
+            if(last) return SMH_ERRORCODE_UNABLE_TO_PARSE;
+            continue;
+        }
+
+        smh_document_patch_add(patch, start, &result.as_success);
+        start = end + 1;
+
+        if(last || (*next < document->chunks_length && smh_document_start(document, *next) == start)){
+            return SMH_ERRORCODE_NONE;
+        }
+    }
+}
+
+// Replaces the old chunks from 'first' up until 'next', and their entries, with the patch
+static void smh_document_splice(struct smh_document *document, size_t first, size_t next, struct smh_document_patch *patch){
+    struct smh_dict *root = &document->root;
+    bool object = document->split.mode == SMH_SPLIT_MAP;
+
+    smh_document_move_shift(document, next);
+
+    size_t entry = smh_document_entry(document, first);
+    size_t replaced = smh_document_entry(document, next) - entry;
+    size_t total = smh_document_entries(root);
+    size_t new_total = total - replaced + patch->length;
+
+    struct smh_string *keys = object ? root->as_object.keys : NULL;
+    struct smh_dict *values = object ? root->as_object.values : root->as_array.items;
+
+    for(size_t i = entry; i < entry + replaced; i++){
+        if(object) smh_string_free(&keys[i]);
+        smh_dict_free(&values[i]);
+    }
+
+    if(new_total > document->root_capacity){
+        while(new_total > document->root_capacity){
+            document->root_capacity = document->root_capacity ? document->root_capacity * 2 : 16;
+        }
+
+        values = smh_realloc(values, sizeof *values * document->root_capacity);
+        if(object) keys = smh_realloc(keys, sizeof *keys * document->root_capacity);
+    }
+
+    // Entries after the patch only move when their number changes
+    size_t tail = total - entry - replaced;
+    bool shift = patch->length != replaced;
+
+    if(shift) memmove(&values[entry + patch->length], &values[entry + replaced], sizeof *values * tail);
+    if(patch->length) memcpy(&values[entry], patch->values, sizeof *values * patch->length);
+
+    if(object){
+        if(shift) memmove(&keys[entry + patch->length], &keys[entry + replaced], sizeof *keys * tail);
+        if(patch->length) memcpy(&keys[entry], patch->keys, sizeof *keys * patch->length);
+
+        root->as_object.keys = keys;
+        root->as_object.values = values;
+        root->as_object.length = new_total;
+    } else {
+        root->as_array.items = values;
+        root->as_array.length = new_total;
+    }
+
+    // Same for the chunks themselves
+    size_t chunks_length = document->chunks_length - (next - first) + patch->chunks_length;
+
+    if(chunks_length > document->chunks_capacity){
+        while(chunks_length > document->chunks_capacity){
+            document->chunks_capacity = document->chunks_capacity ? document->chunks_capacity * 2 : 16;
+        }
+
+        document->chunks = smh_realloc(document->chunks, sizeof *document->chunks * document->chunks_capacity);
+    }
+
+    if(patch->chunks_length != next - first){
+        memmove(&document->chunks[first + patch->chunks_length], &document->chunks[next], sizeof *document->chunks * (document->chunks_length - next));
+    }
+
+    for(size_t i = 0; i < patch->chunks_length; i++){
+        document->chunks[first + i].start = patch->chunks[i].start;
+        document->chunks[first + i].entry = entry + patch->chunks[i].entry;
+    }
+
+    // The chunks after the patch wait for their entries to be renumbered
+    document->chunks_length = chunks_length;
+    document->shifted = first + patch->chunks_length;
+    document->shift_entry += patch->length - replaced;
+
+    // The entries now belong to the document
+    smh_free(patch->chunks);
+    smh_free(patch->keys);
+    smh_free(patch->values);
+}
+
+// Parses all of the markup again, keeping the old tree if that fails
+static enum smh_errorcode smh_document_rebuild(struct smh_document *document){
+    smh_document_move_gap(document, document->length);
+
+    struct smh_split split = smh_split_detect(document->markup, document->length, true);
+
+    if(split.mode == SMH_SPLIT_WHOLE){
+        struct smh_result result = smh_parse_n(document->markup, document->length);
+
+        if(result.ok){
+            smh_dict_free(&document->root);
+            document->root = result.as_success;
+            document->root_capacity = 0;
+            document->chunks_length = 0;
+            document->split = split;
+        }
+
+        document->errorcode = result.ok ? SMH_ERRORCODE_NONE : result.as_failure.errorcode;
+        return document->errorcode;
+    }
+
+    struct smh_split old_split = document->split;
+    size_t next = document->chunks_length;
+    struct smh_document_patch patch = {0};
+
+    document->split = split;
+    enum smh_errorcode errorcode = smh_document_parse(document, 0, &next, &patch);
+
+    if(errorcode){
+        smh_document_patch_free(&patch);
+        document->split = old_split;
+        document->errorcode = errorcode;
+        return errorcode;
+    }
+
+    smh_dict_free(&document->root);
+    memset(&document->root, 0, sizeof document->root);
+    document->root.kind = split.mode == SMH_SPLIT_MAP ? SMH_DICT_OBJECT : SMH_DICT_ARRAY;
+    document->root_capacity = 0;
+    document->chunks_length = 0;
+    document->shifted = 0;
+    document->shift_start = 0;
+    document->shift_entry = 0;
+
+    smh_document_splice(document, 0, 0, &patch);
+    document->errorcode = SMH_ERRORCODE_NONE;
+    return SMH_ERRORCODE_NONE;
+}
+
+// Finds the last chunk beginning at or before 'position'
+static size_t smh_document_chunk_at(const struct smh_document *document, size_t position){
+    size_t low = 0;
+    size_t high = document->chunks_length;
+
+    while(high - low > 1){
+        size_t middle = low + (high - low) / 2;
+
+        if(smh_document_start(document, middle) <= position){
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+struct smh_document *smh_document_create(const char *data, size_t length){
+    struct smh_document *document = smh_calloc(1, sizeof *document);
+    document->root = smh_dict_string_view("", 0);
+    smh_document_edit(document, 0, 0, data, length);
+    return document;
+}
+
+void smh_document_free(struct smh_document *document){
+    smh_dict_free(&document->root);
+    smh_free(document->chunks);
+    smh_free(document->markup);
+    smh_free(document);
+}
+
+enum smh_errorcode smh_document_edit(struct smh_document *document, size_t offset, size_t removed, const char *text, size_t length){
+    if(offset > document->length) offset = document->length;
+    if(removed > document->length - offset) removed = document->length - offset;
+
+    // Chunks the edit touches, along with the one before in case the edit joins onto it
+    size_t first = smh_document_chunk_at(document, offset);
+    size_t last = smh_document_chunk_at(document, offset + removed);
+    if(first) first--;
+
+    smh_document_replace(document, offset, removed, text, length);
+
+    if(document->errorcode || document->chunks_length == 0){
+        return smh_document_rebuild(document);
+    }
+
+    // Old chunks after the edit move along with the markup, and the line that
+    // begins the next of them has to be in reach to tell where reparsing can stop
+    smh_document_move_shift(document, last + 1);
+    document->shift_start += length - removed;
+
+    smh_document_expose(document, last + 1 < document->chunks_length ? smh_document_start(document, last + 1) : document->length);
+
+    // The kind of document is decided by its first entry
+    if(first == 0){
+        struct smh_split split = smh_split_detect(document->markup, document->gap, document->gap == document->length);
+
+        if(split.mode == SMH_SPLIT_UNDECIDED){
+            smh_document_move_gap(document, document->length);
+            split = smh_split_detect(document->markup, document->length, true);
+        }
+
+        if(split.mode != document->split.mode || split.level != document->split.level){
+            return smh_document_rebuild(document);
+        }
+
+        document->split = split;
+    }
+
+    size_t next = last + 1;
+    struct smh_document_patch patch = {0};
+    enum smh_errorcode errorcode = smh_document_parse(document, smh_document_start(document, first), &next, &patch);
+
+    if(errorcode){
+        smh_document_patch_free(&patch);
+        document->errorcode = errorcode;
+        return errorcode;
+    }
+
+    smh_document_splice(document, first, next, &patch);
+    return SMH_ERRORCODE_NONE;
+}
+
+enum smh_errorcode smh_document_error(const struct smh_document *document){
+    return document->errorcode;
+}
+
+const struct smh_dict *smh_document_dict(const struct smh_document *document){
+    return &document->root;
+}
+
+const char *smh_document_markup(struct smh_document *document, size_t *length){
+    smh_document_move_gap(document, document->length);
+    *length = document->length;
+    return document->markup;
+}
+
+static void smh_tape_create(struct smh_tape *tape){
+    tape->nodes = NULL;
+    tape->count = 0;
+    tape->capacity = 0;
+    tape->strings = NULL;
+    tape->strings_length = 0;
+    tape->strings_capacity = 0;
+}
+
+// Tapes viewing a snapshot have no capacity, since they don't own their memory
+void smh_tape_free(struct smh_tape *tape){
+    if(tape->capacity) smh_free(tape->nodes);
+    if(tape->strings_capacity) smh_free(tape->strings);
+    smh_tape_create(tape);
+}
+
+static size_t smh_tape_intern(struct smh_tape *tape, const char *data, size_t length){
+    if(tape->strings_length + length + 1 > tape->strings_capacity){
+        while(tape->strings_length + length + 1 > tape->strings_capacity){
+            tape->strings_capacity = tape->strings_capacity ? tape->strings_capacity * 2 : 256;
+        }
+
+        tape->strings = smh_realloc(tape->strings, tape->strings_capacity);
+    }
+
+    size_t offset = tape->strings_length;
+    if(length) memcpy(&tape->strings[offset], data, length);
+    tape->strings[offset + length] = '\0';
+    tape->strings_length += length + 1;
+    return offset;
+}
+
+static size_t smh_tape_push(struct smh_tape *tape, enum smh_dict_kind kind, size_t parent){
+    if(tape->count == tape->capacity){
+        tape->capacity = tape->capacity ? tape->capacity * 2 : 64;
+        tape->nodes = smh_realloc(tape->nodes, sizeof *tape->nodes * tape->capacity);
+    }
+
+    size_t node = tape->count++;
+    tape->nodes[node].kind = kind;
+    tape->nodes[node].parent = parent;
+    tape->nodes[node].end = node + 1;
+    tape->nodes[node].length = 0;
+    tape->nodes[node].string = 0;
+    tape->nodes[node].key = 0;
+    tape->nodes[node].key_length = 0;
+
+    if(parent != SMH_TAPE_NONE) tape->nodes[parent].length++;
+    return node;
+}
+
+// Builds a tape from parser events, keeping track of which container is open
+struct smh_tape_builder {
+    struct smh_tape *tape;
+    size_t open;
+    size_t key;
+    size_t key_length;
+    bool has_key;
+};
+
+static size_t smh_tape_builder_push(struct smh_tape_builder *builder, enum smh_dict_kind kind){
+    size_t node = smh_tape_push(builder->tape, kind, builder->open);
+
+    if(builder->has_key){
+        builder->tape->nodes[node].key = builder->key;
+        builder->tape->nodes[node].key_length = builder->key_length;
+        builder->has_key = false;
+    }
+
+    return node;
+}
+
+static bool smh_tape_builder_begin_array(void *user){
+    struct smh_tape_builder *builder = user;
+    builder->open = smh_tape_builder_push(builder, SMH_DICT_ARRAY);
+    return true;
+}
+
+static bool smh_tape_builder_begin_object(void *user){
+    struct smh_tape_builder *builder = user;
+    builder->open = smh_tape_builder_push(builder, SMH_DICT_OBJECT);
+    return true;
+}
+
+static bool smh_tape_builder_end(void *user){
+    struct smh_tape_builder *builder = user;
+    struct smh_tape_node *node = &builder->tape->nodes[builder->open];
+    node->end = builder->tape->count;
+    builder->open = node->parent;
+    return true;
+}
+
+static bool smh_tape_builder_key(void *user, const char *data, size_t length){
+    struct smh_tape_builder *builder = user;
+    builder->key = smh_tape_intern(builder->tape, data, length);
+    builder->key_length = length;
+    builder->has_key = true;
+    return true;
+}
+
+static bool smh_tape_builder_string(void *user, const char *data, size_t length){
+    struct smh_tape_builder *builder = user;
+    size_t node = smh_tape_builder_push(builder, SMH_DICT_STRING);
+    builder->tape->nodes[node].string = smh_tape_intern(builder->tape, data, length);
+    builder->tape->nodes[node].length = length;
+    return true;
+}
+
+enum smh_errorcode smh_tape_parse(struct smh_tape *tape, const char *data, size_t length){
+    struct smh_tape_builder builder;
+    struct smh_handler handler;
+
+    smh_tape_create(tape);
+
+    builder.tape = tape;
+    builder.open = SMH_TAPE_NONE;
+    builder.has_key = false;
+
+    handler.user = &builder;
+    handler.begin_array = smh_tape_builder_begin_array;
+    handler.end_array = smh_tape_builder_end;
+    handler.begin_object = smh_tape_builder_begin_object;
+    handler.key = smh_tape_builder_key;
+    handler.string = smh_tape_builder_string;
+    handler.end_object = smh_tape_builder_end;
+
+    enum smh_errorcode errorcode = smh_parse_events(data, length, &handler);
+    if(errorcode) smh_tape_free(tape);
+    return errorcode;
+}
+
+void smh_tape_from_dict(struct smh_tape *tape, const struct smh_dict *dict){
+    struct smh_walk walk;
+    struct smh_walk_step step;
+    size_t open = SMH_TAPE_NONE;
+
+    smh_tape_create(tape);
+    smh_walk_create(&walk, (struct smh_dict*) dict);
+
+    while(smh_walk_next(&walk, &step)){
+        if(step.event == SMH_WALK_END){
+            tape->nodes[open].end = tape->count;
+            open = tape->nodes[open].parent;
+            continue;
+        }
+
+        size_t node = smh_tape_push(tape, step.dict->kind, open);
+
+        if(step.key){
+            size_t offset = smh_tape_intern(tape, step.key->cstr, step.key->length);
+            tape->nodes[node].key = offset;
+            tape->nodes[node].key_length = step.key->length;
+        }
+
+        if(step.event == SMH_WALK_STRING){
+            size_t offset = smh_tape_intern(tape, step.dict->as_string.cstr, step.dict->as_string.length);
+            tape->nodes[node].string = offset;
+            tape->nodes[node].length = step.dict->as_string.length;
+        } else {
+            open = node;
+        }
+    }
+
+    smh_walk_free(&walk);
+}
+
+enum smh_dict_kind smh_tape_kind(const struct smh_tape *tape, size_t node){
+    return tape->nodes[node].kind;
+}
+
+size_t smh_tape_length(const struct smh_tape *tape, size_t node){
+    return tape->nodes[node].length;
+}
+
+const char *smh_tape_string(const struct smh_tape *tape, size_t node){
+    return tape->nodes[node].kind == SMH_DICT_STRING ? &tape->strings[tape->nodes[node].string] : NULL;
+}
+
+const char *smh_tape_key(const struct smh_tape *tape, size_t node, size_t *length){
+    size_t parent = tape->nodes[node].parent;
+    if(parent == SMH_TAPE_NONE || tape->nodes[parent].kind != SMH_DICT_OBJECT) return NULL;
+
+    if(length) *length = tape->nodes[node].key_length;
+    return &tape->strings[tape->nodes[node].key];
+}
+
+size_t smh_tape_parent(const struct smh_tape *tape, size_t node){
+    return tape->nodes[node].parent;
+}
+
+size_t smh_tape_child(const struct smh_tape *tape, size_t node){
+    return tape->nodes[node].kind != SMH_DICT_STRING && tape->nodes[node].length ? node + 1 : SMH_TAPE_NONE;
+}
+
+size_t smh_tape_next(const struct smh_tape *tape, size_t node){
+    size_t parent = tape->nodes[node].parent;
+    size_t next = tape->nodes[node].end;
+
+    return parent != SMH_TAPE_NONE && next < tape->nodes[parent].end ? next : SMH_TAPE_NONE;
+}
+
+size_t smh_tape_subtree_size(const struct smh_tape *tape, size_t node){
+    return tape->nodes[node].end - node;
+}
+
+struct smh_tape_iterator smh_tape_iterate(const struct smh_tape *tape, size_t container){
+    struct smh_tape_iterator iterator;
+    iterator.tape = tape;
+    iterator.node = smh_tape_child(tape, container);
+    return iterator;
+}
+
+bool smh_tape_iterator_next(struct smh_tape_iterator *iterator, size_t *node){
+    if(iterator->node == SMH_TAPE_NONE) return false;
+
+    *node = iterator->node;
+    iterator->node = smh_tape_next(iterator->tape, iterator->node);
+    return true;
+}
+
+struct smh_result smh_tape_to_dict(const struct smh_tape *tape, size_t root){
+    struct smh_parser parser;
+    struct smh_builder builder;
+    struct smh_handler handler;
+
+    // Replay the tape as events into the tree builder
+    smh_parser_create(&parser, 0, "", 0);
+    smh_builder_create(&builder, &handler, &parser);
+
+    size_t base = tape->nodes[root].parent;
+    size_t open = base;
+
+    for(size_t node = root; node < tape->nodes[root].end; node++){
+        const struct smh_tape_node *current = &tape->nodes[node];
+
+        while(open != current->parent){
+            smh_builder_end(&builder);
+            open = tape->nodes[open].parent;
+        }
+
+        if(node != root && tape->nodes[open].kind == SMH_DICT_OBJECT){
+            smh_builder_key(&builder, &tape->strings[current->key], current->key_length);
+        }
+
+        switch(current->kind){
+        case SMH_DICT_STRING:
+            smh_builder_string_value(&builder, &tape->strings[current->string], current->length);
+            break;
+        case SMH_DICT_ARRAY:
+            smh_builder_begin_array(&builder);
+            open = node;
+            break;
+        case SMH_DICT_OBJECT:
+            smh_builder_begin_object(&builder);
+            open = node;
+            break;
+        }
+    }
+
+    while(open != base){
+        smh_builder_end(&builder);
+        open = tape->nodes[open].parent;
+    }
+
+    smh_free(builder.frames);
+    return smh_result_success(builder.root);
+}
+
+// Snapshots are a header followed by the nodes of the tape, then its strings
+struct smh_snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t node_size;
+    uint32_t word_size;
+    uint64_t count;
+    uint64_t strings_length;
+    uint64_t checksum;
+};
+
+static const char smh_snapshot_magic[8] = "SMHSNAP";
+
+// Four independent multiply-xor lanes over 8-byte words, so that verifying
+// a snapshot runs much faster than parsing the document would
+static uint64_t smh_checksum(const char *data, size_t length){
+    uint64_t lanes[4] = {0xcbf29ce484222325ULL, 0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL};
+    size_t i = 0;
+
+    for(; i + 32 <= length; i += 32){
+        for(int lane = 0; lane < 4; lane++){
+            uint64_t word;
+            memcpy(&word, &data[i + lane * 8], 8);
+            lanes[lane] = (lanes[lane] ^ word) * 0x100000001b3ULL;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    uint64_t hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7) ^ length;
+
+    for(; i < length; i++){
+        hash = (hash ^ (unsigned char) data[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+void *smh_snapshot_create(const struct smh_tape *tape, size_t *length){
+    size_t nodes_size = sizeof *tape->nodes * tape->count;
+    size_t total = sizeof(struct smh_snapshot_header) + nodes_size + tape->strings_length;
+    char *snapshot = smh_malloc(total);
+
+    struct smh_snapshot_header header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, smh_snapshot_magic, sizeof header.magic);
+    header.version = SMH_SNAPSHOT_VERSION;
+    header.byte_order = 0x01020304;
+    header.node_size = sizeof *tape->nodes;
+    header.word_size = sizeof(size_t);
+    header.count = tape->count;
+    header.strings_length = tape->strings_length;
+
+    // Nodes are copied field by field so that their padding is always zero
+    char *body = &snapshot[sizeof header];
+    struct smh_tape_node *nodes = (struct smh_tape_node*) body;
+    memset(body, 0, nodes_size);
+
+    for(size_t i = 0; i < tape->count; i++){
+        nodes[i].kind = tape->nodes[i].kind;
+        nodes[i].parent = tape->nodes[i].parent;
+        nodes[i].end = tape->nodes[i].end;
+        nodes[i].length = tape->nodes[i].length;
+        nodes[i].string = tape->nodes[i].string;
+        nodes[i].key = tape->nodes[i].key;
+        nodes[i].key_length = tape->nodes[i].key_length;
+    }
+
+    if(tape->strings_length) memcpy(&body[nodes_size], tape->strings, tape->strings_length);
+
+    header.checksum = smh_checksum(body, nodes_size + tape->strings_length);
+    memcpy(snapshot, &header, sizeof header);
+
+    *length = total;
+    return snapshot;
+}
+
+// Whether every node stays within the tape, so accessors can trust it
+// Containers must have as many children as they say, found by hopping from one sibling to the next
+static bool smh_snapshot_has_children(const struct smh_tape *tape, size_t container){
+    const struct smh_tape_node *current = &tape->nodes[container];
+    if(current->kind == SMH_DICT_STRING) return true;
+
+    size_t children = 0;
+
+    for(size_t child = container + 1; child < current->end; child = tape->nodes[child].end){
+        children++;
+    }
+
+    return children == current->length;
+}
+
+// Nodes are checked in order while following the containers still open,
+// so that each one must be a child of the innermost of them
+static bool smh_snapshot_is_consistent(const struct smh_tape *tape){
+    if(tape->count == 0) return true;
+    if(tape->nodes[0].end != tape->count) return false;
+
+    size_t open = SMH_TAPE_NONE;
+
+    for(size_t node = 0; node < tape->count; node++){
+        const struct smh_tape_node *current = &tape->nodes[node];
+
+        if(current->kind != SMH_DICT_STRING && current->kind != SMH_DICT_ARRAY && current->kind != SMH_DICT_OBJECT) return false;
+        if(current->end <= node || current->end > tape->count) return false;
+
+        while(open != SMH_TAPE_NONE && tape->nodes[open].end <= node){
+            if(!smh_snapshot_has_children(tape, open)) return false;
+            open = tape->nodes[open].parent;
+        }
+
+        if(current->parent != open || (node != 0 && open == SMH_TAPE_NONE)) return false;
+
+        if(open != SMH_TAPE_NONE){
+            const struct smh_tape_node *parent = &tape->nodes[open];
+            if(current->end > parent->end) return false;
+
+            if(parent->kind == SMH_DICT_OBJECT){
+                if(current->key >= tape->strings_length || current->key_length >= tape->strings_length - current->key) return false;
+                if(tape->strings[current->key + current->key_length] != '\0') return false;
+            }
+        }
+
+        if(current->kind == SMH_DICT_STRING){
+            if(current->end != node + 1) return false;
+            if(current->string >= tape->strings_length || current->length >= tape->strings_length - current->string) return false;
+            if(tape->strings[current->string + current->length] != '\0') return false;
+        } else {
+            open = node;
+        }
+    }
+
+    while(open != SMH_TAPE_NONE){
+        if(!smh_snapshot_has_children(tape, open)) return false;
+        open = tape->nodes[open].parent;
+    }
+
+    return true;
+}
+
+enum smh_errorcode smh_snapshot_open(struct smh_tape *tape, const void *data, size_t length){
+    struct smh_snapshot_header header;
+    smh_tape_create(tape);
 
-    while(smh_parser_peek(parser) == character){
-        parser->index++;
+    if(length < sizeof header || (uintptr_t) data % _Alignof(struct smh_tape_node) != 0){
+        return SMH_ERRORCODE_BAD_SNAPSHOT;
     }
 
-    return parser->index - beginning;
-}
+    memcpy(&header, data, sizeof header);
 
-#define smh_parser_forbid(PARSER_PTR, CHARACTER, ERRORCODE) do {\
-        if(smh_parser_peek((PARSER_PTR)) == (CHARACTER)){\
-            return smh_result_failure(smh_failure((ERRORCODE))); \
-        } \
-    } while(0);
+    bool compatible = memcmp(header.magic, smh_snapshot_magic, sizeof header.magic) == 0
+                   && header.version == SMH_SNAPSHOT_VERSION
+                   && header.byte_order == 0x01020304
+                   && header.node_size == sizeof(struct smh_tape_node)
+                   && header.word_size == sizeof(size_t);
 
-static struct smh_result smh_parser_parse_quoted_string(struct smh_parser *parser);
-static struct smh_result smh_parser_parse_bracket_array(struct smh_parser *parser);
-static struct smh_result smh_parser_parse_bullet_array(struct smh_parser *parser, size_t level);
-static struct smh_result smh_parser_parse_unquoted_string(struct smh_parser *parser, const char *terminators);
-static struct smh_result smh_parser_parse_map(struct smh_parser *parser, size_t level);
+    if(!compatible || header.count > (length - sizeof header) / sizeof(struct smh_tape_node)){
+        return SMH_ERRORCODE_BAD_SNAPSHOT;
+    }
 
-static struct smh_result smh_parser_parse(struct smh_parser *parser, enum smh_parent_kind parent_kind, int preexisting_indentation){
-    smh_parser_ignore(parser, '\n');
-    smh_parser_forbid(parser, '\t', SMH_ERRORCODE_TAB_NOT_ALLOWED);
+    const char *body = (const char*) data + sizeof header;
+    size_t nodes_size = sizeof(struct smh_tape_node) * header.count;
 
-    size_t level = smh_parser_ignore(parser, ' ') / 2 + preexisting_indentation;
+    if(header.strings_length != length - sizeof header - nodes_size || smh_checksum(body, length - sizeof header) != header.checksum){
+        return SMH_ERRORCODE_BAD_SNAPSHOT;
+    }
 
-    smh_parser_forbid(parser, '\t', SMH_ERRORCODE_TAB_NOT_ALLOWED);
+    tape->nodes = (struct smh_tape_node*) body;
+    tape->count = header.count;
+    tape->strings = (char*) &body[nodes_size];
+    tape->strings_length = header.strings_length;
 
-    if(smh_parser_peek(parser) == '"'){
-        return smh_parser_parse_quoted_string(parser);
+    if(!smh_snapshot_is_consistent(tape)){
+        smh_tape_create(tape);
+        return SMH_ERRORCODE_BAD_SNAPSHOT;
     }
 
-    if(smh_parser_peek(parser) == '['){
-        return smh_parser_parse_bracket_array(parser);
+    return SMH_ERRORCODE_NONE;
+}
+
+enum smh_errorcode smh_snapshot_load(struct smh_tape *tape, const char *path, struct smh_file *file){
+    smh_tape_create(tape);
+
+    if(!smh_file_open(file, path)){
+        return SMH_ERRORCODE_UNABLE_TO_OPEN;
     }
 
-    if(smh_parser_peek(parser) == '-' && smh_parser_peek_ahead(parser, 1) == ' '){
-        return smh_parser_parse_bullet_array(parser, level);
+    enum smh_errorcode errorcode = smh_snapshot_open(tape, file->data, file->length);
+    if(errorcode) smh_file_free(file);
+    return errorcode;
+}
+
+#ifdef SMH_PARSER_CACHE
+    static bool smh_file_open_fd(struct smh_file *file, int fd, const struct stat *info);
+
+    // Files are considered unchanged while they are the same file with the same modification time,
+    // which is kept to the nanosecond where the system exposes it
+    struct smh_file_stamp {
+        unsigned long long device;
+        unsigned long long inode;
+        long long seconds;
+        long long nanoseconds;
+
+        // When the file was opened, in seconds. Files modified during that second may have been
+        // written again since without their stamp changing, so they're never taken from the cache
+        long long opened;
+    };
+
+    static struct smh_file_stamp smh_file_stamp(const struct stat *info, long long opened){
+        struct smh_file_stamp stamp;
+        stamp.opened = opened;
+        stamp.device = (unsigned long long) info->st_dev;
+        stamp.inode = (unsigned long long) info->st_ino;
+        stamp.seconds = (long long) info->st_mtime;
+
+        // st_mtime is defined in terms of st_mtim when the system has it
+        #if defined(__APPLE__)
+            stamp.nanoseconds = info->st_mtimespec.tv_nsec;
+        #elif defined(st_mtime)
+            stamp.nanoseconds = info->st_mtim.tv_nsec;
+        #else
+            stamp.nanoseconds = 0;
+        #endif
+
+        return stamp;
     }
 
-    if(parent_kind == SMH_PARENT_BRACKET){
-        return smh_parser_parse_unquoted_string(parser, "\n,]");
+    static bool smh_file_stamp_equals(const struct smh_file_stamp *a, const struct smh_file_stamp *b){
+        return a->device == b->device && a->inode == b->inode && a->seconds == b->seconds && a->nanoseconds == b->nanoseconds;
     }
 
-    size_t start = parser->index;
+    struct smh_shared {
+        struct smh_dict root;
+        struct smh_arena arena;
+        size_t references;
+        size_t memory;
+
+        // Documents are keyed by a hash of their markup, files also by path and what fstat says of them
+        uint64_t hash;
+        size_t length;
+        char *path;
 
-    struct smh_result value = smh_parser_parse_unquoted_string(parser, "\n:");
-    if(!value.ok) return value;
+        // The hash is easy to collide, so the markup of documents without a path is kept to compare
+        char *markup;
+        struct smh_file_stamp stamp;
 
-    if(smh_parser_peek(parser) == ':'){
-        smh_dict_free(&value.as_success);
+        // Neighbours in the cache, from most to least recently used
+        struct smh_shared *previous;
+        struct smh_shared *next;
+    };
 
-        parser->index = start;
-        return smh_parser_parse_map(parser, parent_kind == SMH_PARENT_BULLET ? level + 1 : level);
+    // The cache holds few, large documents, so they are found by walking the recency list
+    static struct {
+        pthread_mutex_t lock;
+        struct smh_shared *first;
+        struct smh_shared *last;
+        struct smh_cache_stats stats;
+    } smh_cache = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, { .limit = SMH_PARSER_CACHE_LIMIT } };
+
+    static void smh_shared_destroy(struct smh_shared *shared){
+        smh_arena_free(&shared->arena);
+        smh_free(shared->path);
+        smh_free(shared->markup);
+        smh_free(shared);
     }
 
-    return value;
-}
+    static void smh_cache_unlink(struct smh_shared *shared){
+        if(shared->previous) shared->previous->next = shared->next;
+        else smh_cache.first = shared->next;
 
-static bool smh_parser_did_parse_completely(struct smh_parser *parser){
-    char character = smh_parser_peek(parser);
+        if(shared->next) shared->next->previous = shared->previous;
+        else smh_cache.last = shared->previous;
+    }
 
-    while(character){
-        if(character != '\n' && character != ' '){
-            return false;
-        }
+    static void smh_cache_push_front(struct smh_shared *shared){
+        shared->previous = NULL;
+        shared->next = smh_cache.first;
 
-        parser->index++;
-        character = smh_parser_peek(parser);
+        if(smh_cache.first) smh_cache.first->previous = shared;
+        else smh_cache.last = shared;
+
+        smh_cache.first = shared;
     }
 
-    return true;
-}
+    // Removes a document from the cache along with the cache's reference to it
+    static void smh_cache_evict(struct smh_shared *shared){
+        smh_cache_unlink(shared);
 
-static struct smh_result smh_parser_parse_quoted_string(struct smh_parser *parser){
-    parser->index++;
+        smh_cache.stats.memory -= shared->memory;
+        smh_cache.stats.entries--;
+        smh_cache.stats.evictions++;
 
-    char *content = malloc(8);
-    size_t length = 0;
+        if(--shared->references == 0) smh_shared_destroy(shared);
+    }
 
-    char character = smh_parser_peek(parser);
+    static void smh_cache_trim(void){
+        while(smh_cache.last && smh_cache.stats.memory > smh_cache.stats.limit){
+            smh_cache_evict(smh_cache.last);
+        }
+    }
 
-    while(character && character != '"'){
-        if(character == '\\'){
-            char substitution;
+    static struct smh_shared *smh_cache_find(const char *data, uint64_t hash, size_t length, const char *path, const struct smh_file_stamp *stamp){
+        for(struct smh_shared *shared = smh_cache.first; shared; shared = shared->next){
+            if(shared->hash != hash || shared->length != length) continue;
 
-            switch(smh_parser_peek_ahead(parser, 1)){
-            case 'n':
-                substitution = '\n';
-                break;
-            case '"':
-                substitution = '\"';
-                break;
-            case '\\':
-                substitution = '\\';
-                break;
-            default:
-                substitution = '\0';
+            if(path == NULL ? shared->markup && memcmp(shared->markup, data, length) == 0 : shared->path && smh_file_stamp_equals(&shared->stamp, stamp) && shared->stamp.seconds < shared->stamp.opened && strcmp(shared->path, path) == 0){
+                return shared;
             }
+        }
 
-            if(substitution){
-                content = realloc(content, length + 2);
-                content[length++] = substitution;
-            }
+        return NULL;
+    }
 
-            parser->index++;
+    static struct smh_shared *smh_cache_lookup(const char *data, uint64_t hash, size_t length, const char *path, const struct smh_file_stamp *stamp){
+        pthread_mutex_lock(&smh_cache.lock);
+        struct smh_shared *shared = smh_cache_find(data, hash, length, path, stamp);
+
+        if(shared){
+            smh_cache_unlink(shared);
+            smh_cache_push_front(shared);
+            shared->references++;
+            smh_cache.stats.hits++;
         } else {
-            content = realloc(content, length + 2);
-            content[length++] = character;
+            smh_cache.stats.misses++;
         }
 
-        parser->index++;
-        character = smh_parser_peek(parser);
-    }
-
-    if(!character){
-        return smh_result_failure(smh_failure(SMH_ERRORCODE_UNTERMINATED));
+        pthread_mutex_unlock(&smh_cache.lock);
+        return shared;
     }
 
-    content[length] = '\0';
+    // Parses outside of the lock, so another thread may have cached the same document in the meantime
+    static struct smh_shared *smh_cache_insert(const char *data, size_t length, uint64_t hash, const char *path, const struct smh_file_stamp *stamp, enum smh_errorcode *errorcode){
+        struct smh_shared *shared = smh_malloc(sizeof *shared);
+        smh_arena_create(&shared->arena, 0);
 
-    parser->index++;
-    return smh_result_success(smh_dict_string(content));
-}
+        struct smh_options options = {0};
+        options.arena = &shared->arena;
 
-static struct smh_result smh_parser_parse_bracket_array(struct smh_parser *parser){
-    struct smh_dict *items = NULL;
-    size_t length = 0;
+        struct smh_result result = smh_parse_n_ex(data, length, &options);
 
-    parser->index++;
+        if(!result.ok){
+            if(errorcode) *errorcode = result.as_failure.errorcode;
+            smh_arena_free(&shared->arena);
+            smh_free(shared);
+            return NULL;
+        }
 
-    while(parser->index < parser->length){
-        smh_parser_ignore(parser, '\n');
-        smh_parser_ignore(parser, ' ');
+        shared->root = result.as_success;
+        shared->references = 2;
+        shared->memory = sizeof *shared;
+        shared->hash = hash;
+        shared->length = length;
+        shared->path = NULL;
+        shared->markup = NULL;
+        if(stamp) shared->stamp = *stamp;
+
+        for(struct smh_arena_block *block = shared->arena.first; block; block = block->next){
+            shared->memory += sizeof *block + block->capacity;
+        }
 
-        if(smh_parser_peek(parser) == ']'){
-            parser->index++;
-            return smh_result_success(smh_dict_array(items, length));
+        if(path){
+            shared->path = smh_malloc(strlen(path) + 1);
+            strcpy(shared->path, path);
+        } else {
+            shared->markup = smh_malloc(length + 1);
+            memcpy(shared->markup, data, length);
+            shared->memory += length;
         }
 
-        struct smh_result element = smh_parser_parse(parser, SMH_PARENT_BRACKET, 0);
+        pthread_mutex_lock(&smh_cache.lock);
+        struct smh_shared *existing = smh_cache_find(data, hash, length, path, stamp);
+
+        if(existing){
+            existing->references++;
+            pthread_mutex_unlock(&smh_cache.lock);
 
-        if(!element.ok){
-            smh_dicts_free(items, length);
-            return element;
+            smh_shared_destroy(shared);
+            return existing;
         }
 
-        items = realloc(items, sizeof *items * (length + 1));
-        items[length++] = element.as_success;
+        // Earlier versions of a file won't be asked for again
+        for(struct smh_shared *other = smh_cache.first; path && other;){
+            struct smh_shared *next = other->next;
+            if(other->path && strcmp(other->path, path) == 0) smh_cache_evict(other);
+            other = next;
+        }
 
-        smh_parser_ignore(parser, '\n');
+        smh_cache_push_front(shared);
+        smh_cache.stats.memory += shared->memory;
+        smh_cache.stats.entries++;
+        smh_cache_trim();
 
-        if(smh_parser_peek(parser) == ','){
-            parser->index++;
-        }
+        pthread_mutex_unlock(&smh_cache.lock);
+        return shared;
     }
 
-    smh_dicts_free(items, length);
-    return smh_result_failure(smh_failure(SMH_ERRORCODE_UNTERMINATED));
-}
+    struct smh_shared *smh_cache_parse(const char *data, size_t length, enum smh_errorcode *errorcode){
+        uint64_t hash = smh_checksum(data, length);
+        struct smh_shared *shared = smh_cache_lookup(data, hash, length, NULL, NULL);
 
-static struct smh_result smh_parser_parse_bullet_array(struct smh_parser *parser, size_t level){
-    parser->index++;
+        return shared ? shared : smh_cache_insert(data, length, hash, NULL, NULL, errorcode);
+    }
 
-    smh_parser_ignore(parser, ' ');
+    struct smh_shared *smh_cache_parse_file(const char *path, enum smh_errorcode *errorcode){
+        // The file is read through the same descriptor it was looked up by,
+        // so that it can't be replaced in between
+        long long opened = (long long) time(NULL);
+        int fd = open(path, O_RDONLY);
+        struct stat status;
+
+        if(fd < 0 || fstat(fd, &status) != 0){
+            if(fd >= 0) close(fd);
+            if(errorcode) *errorcode = SMH_ERRORCODE_UNABLE_TO_OPEN;
+            return NULL;
+        }
 
-    struct smh_result element = smh_parser_parse(parser, SMH_PARENT_BULLET, level);
-    if(!element.ok) return element;
+        // The hash of a file is only its size, files are told apart by path and stamp
+        size_t length = status.st_size;
+        struct smh_file_stamp stamp = smh_file_stamp(&status, opened);
+        struct smh_shared *shared = smh_cache_lookup(NULL, length, length, path, &stamp);
 
-    struct smh_dict *items = malloc(sizeof *items * 4);
-    size_t length = 0;
+        if(shared){
+            close(fd);
+            return shared;
+        }
 
-    items[length++] = element.as_success;
+        struct smh_file file;
+        bool loaded = smh_file_open_fd(&file, fd, &status);
+        close(fd);
 
-    smh_parser_ignore(parser, ' ');
+        if(!loaded){
+            if(errorcode) *errorcode = SMH_ERRORCODE_UNABLE_TO_OPEN;
+            return NULL;
+        }
 
-    while(smh_parser_peek(parser) == '\n'){
-        size_t start_of_line = parser->index++;
-        size_t indentation = smh_parser_ignore(parser, ' ') / 2;
+        shared = smh_cache_insert(file.data, file.length, length, path, &stamp, errorcode);
+        smh_file_free(&file);
+        return shared;
+    }
 
-        if(indentation >= level && smh_parser_peek(parser) == '-' && smh_parser_peek_ahead(parser, 1) == ' '){
-            parser->index++;
-            smh_parser_ignore(parser, ' ');
+    const struct smh_dict *smh_shared_dict(const struct smh_shared *shared){
+        return &shared->root;
+    }
 
-            level = indentation;
+    struct smh_shared *smh_shared_retain(struct smh_shared *shared){
+        pthread_mutex_lock(&smh_cache.lock);
+        shared->references++;
+        pthread_mutex_unlock(&smh_cache.lock);
+        return shared;
+    }
 
-            element = smh_parser_parse(parser, SMH_PARENT_BULLET, level);
+    void smh_shared_release(struct smh_shared *shared){
+        pthread_mutex_lock(&smh_cache.lock);
+        if(--shared->references == 0) smh_shared_destroy(shared);
+        pthread_mutex_unlock(&smh_cache.lock);
+    }
 
-            if(!element.ok){
-                smh_dicts_free(items, length);
-                return element;
-            }
+    void smh_cache_set_limit(size_t limit){
+        pthread_mutex_lock(&smh_cache.lock);
+        smh_cache.stats.limit = limit;
+        smh_cache_trim();
+        pthread_mutex_unlock(&smh_cache.lock);
+    }
 
-            items = realloc(items, sizeof *items * (length + 1));
-            items[length++] = element.as_success;
-        } else {
-            parser->index = start_of_line;
-            break;
+    struct smh_cache_stats smh_cache_get_stats(void){
+        pthread_mutex_lock(&smh_cache.lock);
+        struct smh_cache_stats stats = smh_cache.stats;
+        pthread_mutex_unlock(&smh_cache.lock);
+        return stats;
+    }
+
+    void smh_cache_clear(void){
+        pthread_mutex_lock(&smh_cache.lock);
+
+        while(smh_cache.last){
+            smh_cache_evict(smh_cache.last);
         }
 
-        smh_parser_ignore(parser, ' ');
+        pthread_mutex_unlock(&smh_cache.lock);
     }
+#endif // SMH_PARSER_CACHE
 
-    return smh_result_success(smh_dict_array(items, length));
+struct smh_result smh_parse_file(const char *path, struct smh_file *file){
+    struct smh_options options = {0};
+    return smh_parse_file_ex(path, file, &options);
 }
 
-static struct smh_result smh_parser_parse_unquoted_string(struct smh_parser *parser, const char *terminators){
-    char *content = malloc(8);
-    size_t length = 0;
-
-    char character = smh_parser_peek(parser);
-
-    while(character && strchr(terminators, character) == NULL){
-        parser->index++;
+struct smh_result smh_parse_file_ex(const char *path, struct smh_file *file, const struct smh_options *options){
+    if(!smh_file_open(file, path)){
+        return smh_result_failure(smh_failure(SMH_ERRORCODE_UNABLE_TO_OPEN));
+    }
 
-        content = realloc(content, length + 2);
-        content[length++] = character;
+    struct smh_result result = smh_parse_n_ex(file->data, file->length, options);
 
-        character = smh_parser_peek(parser);
+    if(!result.ok){
+        smh_file_free(file);
     }
 
-    content[length] = '\0';
-    return smh_result_success(smh_dict_string(content));
+    return result;
 }
 
-static struct smh_result smh_parser_parse_map(struct smh_parser *parser, size_t level){
-    struct smh_result key = smh_parser_parse_unquoted_string(parser, "\n:");
-    if(!key.ok) return key;
+#if defined(SMH_PARSER_USE_MMAP) || defined(SMH_PARSER_CACHE)
+    // Reads until the end of the stream, for whatever can't be mapped. Files that turn out
+    // to be empty don't keep a buffer, their data is a static empty string
+    static bool smh_file_read_fd(struct smh_file *file, int fd){
+        char *buffer = NULL;
+        size_t length = 0;
+        size_t capacity = 0;
 
-    parser->index++;
+        for(;;){
+            if(length == capacity){
+                capacity = capacity ? capacity * 2 : 4096;
+                buffer = smh_realloc(buffer, capacity);
+            }
+
+            ssize_t count = read(fd, &buffer[length], capacity - length);
+
+            if(count < 0){
+                smh_free(buffer);
+                return false;
+            }
+
+            if(count == 0) break;
+            length += (size_t) count;
+        }
 
-    struct smh_result value = smh_parser_parse(parser, SMH_PARENT_NULL, 0);
+        if(length == 0) smh_free(buffer);
 
-    if(!value.ok){
-        smh_dict_free(&key.as_success);
-        return value;
+        file->data = length ? buffer : "";
+        file->length = length;
+        file->mapped = false;
+        return true;
     }
+#endif
+
+#ifdef SMH_PARSER_USE_MMAP
+    // Opens what 'fd' refers to, as described by 'info', leaving the descriptor open
+    static bool smh_file_open_fd(struct smh_file *file, int fd, const struct stat *info){
+        // Pipes and devices have no size to map, and files under /proc claim to be empty
+        if(!S_ISREG(info->st_mode) || info->st_size == 0){
+            return smh_file_read_fd(file, fd);
+        }
 
-    struct smh_string *keys = malloc(sizeof *keys * 4);
-    struct smh_dict *values = malloc(sizeof *values * 4);
-    size_t length = 0;
+        file->length = (size_t) info->st_size;
 
-    keys[length] = key.as_success.as_string;
-    values[length] = value.as_success;
-    length++;
+        void *mapping = mmap(NULL, file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED) return false;
 
-    while(smh_parser_peek(parser) == '\n'){
-        size_t start = parser->index;
+        #if defined(MADV_SEQUENTIAL)
+            madvise(mapping, file->length, MADV_SEQUENTIAL);
+            madvise(mapping, file->length, MADV_WILLNEED);
+        #elif defined(POSIX_MADV_SEQUENTIAL)
+            posix_madvise(mapping, file->length, POSIX_MADV_SEQUENTIAL);
+            posix_madvise(mapping, file->length, POSIX_MADV_WILLNEED);
+        #endif
 
-        smh_parser_ignore(parser, '\n');
-        size_t indentation = smh_parser_ignore(parser, ' ') / 2;
+        file->data = mapping;
+        file->mapped = true;
+        return true;
+    }
 
-        if(indentation != level){
-            parser->index = start;
-            break;
-        }
+    bool smh_file_open(struct smh_file *file, const char *path){
+        int fd = open(path, O_RDONLY);
+        if(fd < 0) return false;
+
+        struct stat info;
+        bool opened = fstat(fd, &info) == 0 && smh_file_open_fd(file, fd, &info);
 
-        key = smh_parser_parse_unquoted_string(parser, "\n:");
+        close(fd);
+        return opened;
+    }
 
-        if(!key.ok){
-            smh_strings_free(keys, length);
-            smh_dicts_free(values, length);
-            return key;
+    void smh_file_free(struct smh_file *file){
+        if(file->mapped){
+            munmap((void*) file->data, file->length);
+        } else if(file->length){
+            smh_free((void*) file->data);
         }
 
-        if(smh_parser_peek(parser) != ':'){
-            parser->index = start;
-            smh_dict_free(&key.as_success);
-            break;
+        file->data = NULL;
+        file->length = 0;
+        file->mapped = false;
+    }
+#else
+    #ifdef SMH_PARSER_CACHE
+        static bool smh_file_open_fd(struct smh_file *file, int fd, const struct stat *info){
+            (void) info;
+            return smh_file_read_fd(file, fd);
         }
+    #endif
 
-        parser->index++;
+    bool smh_file_open(struct smh_file *file, const char *path){
+        FILE *stream = fopen(path, "rb");
+        if(stream == NULL) return false;
 
-        value = smh_parser_parse(parser, SMH_PARENT_MAP, 0);
+        char *buffer = NULL;
+        size_t length = 0;
+        size_t capacity = 0;
 
-        keys = realloc(keys, sizeof *keys * (length + 1));
-        values = realloc(values, sizeof *values * (length + 1));
-        keys[length] = key.as_success.as_string;
-        values[length] = value.as_success;
-        length++;
-    }
+        for(;;){
+            if(length == capacity){
+                capacity = capacity ? capacity * 2 : 4096;
+                buffer = smh_realloc(buffer, capacity);
+            }
 
-    return smh_result_success(smh_dict_object(keys, values, length));
-}
+            size_t count = fread(&buffer[length], 1, capacity - length, stream);
+            if(count == 0) break;
+            length += count;
+        }
 
+        bool failed = ferror(stream);
+        fclose(stream);
 
+        if(failed || length == 0) smh_free(buffer);
+        if(failed) return false;
 
-struct smh_result smh_parse(const char *markup){
-    struct smh_parser parser;
-    smh_parser_create(&parser, 0, markup);
+        // Like empty files read any other way, these don't keep a buffer
+        file->data = length ? buffer : "";
+        file->length = length;
+        file->mapped = false;
+        return true;
+    }
 
-    struct smh_result document = smh_parser_parse(&parser, SMH_PARENT_NULL, 0);
+    void smh_file_free(struct smh_file *file){
+        if(file->length) smh_free((void*) file->data);
 
-    if(smh_parser_did_parse_completely(&parser) || !document.ok){
-        return document;
-    } else {
-        smh_result_free(&document);
-        return smh_result_failure(smh_failure(SMH_ERRORCODE_UNABLE_TO_PARSE));
+        file->data = NULL;
+        file->length = 0;
+        file->mapped = false;
     }
-
-}
+#endif // SMH_PARSER_USE_MMAP
 
 void smh_result_free(struct smh_result *result){
     if(!result->ok) return; // Nothing to free
+    if(result->arena) return; // Owned by the arena
 
     smh_dict_free(&result->as_success);
 }
 
+void smh_arena_create(struct smh_arena *arena, size_t block_size){
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size ? block_size : SMH_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void smh_arena_reset(struct smh_arena *arena){
+    for(struct smh_arena_block *block = arena->first; block; block = block->next){
+        block->used = 0;
+    }
+
+    arena->current = arena->first;
+}
+
+void smh_arena_free(struct smh_arena *arena){
+    struct smh_arena_block *block = arena->first;
+
+    while(block){
+        struct smh_arena_block *next = block->next;
+        smh_free(block);
+        block = next;
+    }
+
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
 const char *smh_failure_str(struct smh_failure *failure){
     switch(failure->errorcode){
     case SMH_ERRORCODE_NONE: return "none";
     case SMH_ERRORCODE_UNTERMINATED: return "unterminated construct";
     case SMH_ERRORCODE_UNABLE_TO_PARSE: return "unable to fully parse";
     case SMH_ERRORCODE_TAB_NOT_ALLOWED: return "tabs are not allowed as indentation";
+    case SMH_ERRORCODE_UNABLE_TO_OPEN: return "unable to open file";
+    case SMH_ERRORCODE_ABORTED: return "stopped by handler";
+    case SMH_ERRORCODE_TOO_DEEP: return "nested too deeply";
+    case SMH_ERRORCODE_BAD_SNAPSHOT: return "not a usable snapshot";
+    case SMH_ERRORCODE_MISSING_FIELD: return "missing required field";
+    case SMH_ERRORCODE_BAD_VALUE: return "value doesn't fit its field";
     default: return "unknown";
     }
 }
 
 #ifndef SMH_PARSER_NO_HELPERS
-    char *smh_dict_json(struct smh_dict *dict){
-        switch(dict->kind){
-        case SMH_DICT_STRING:
-            return smh_string_json(&dict->as_string);
-        case SMH_DICT_ARRAY:
-            return smh_array_json(&dict->as_array);
-        case SMH_DICT_OBJECT:
-            return smh_object_json(&dict->as_object);
-        default:
-            return calloc(1, 1);
+    #if defined(__unix__) || defined(__APPLE__)
+        #include <errno.h>
+        #include <unistd.h>
+    #endif
+
+    // Output going to a writer is handed over whenever this much has been buffered
+    #define SMH_WRITER_CHUNK_SIZE 65536
+
+    static void smh_buffer_reserve(struct smh_buffer *buffer, size_t additional){
+        if(buffer->length + additional + 1 <= buffer->capacity) return;
+
+        while(buffer->length + additional + 1 > buffer->capacity){
+            buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 64;
         }
+
+        buffer->data = smh_realloc(buffer->data, buffer->capacity);
     }
 
-    char *smh_string_json(struct smh_string *string){
+    static void smh_buffer_append(struct smh_buffer *buffer, const char *data, size_t length){
+        smh_buffer_reserve(buffer, length);
+        memcpy(&buffer->data[buffer->length], data, length);
+        buffer->length += length;
+        buffer->data[buffer->length] = '\0';
+    }
+
+    static void smh_buffer_append_json_string(struct smh_buffer *buffer, const struct smh_string *string){
         // Since parsing quoted strings can lose information of ignored escapes,
         // ignored escapes will not be reversed properly.
 
-        size_t num_special_characters = 0;
-
-        for(char *s = string->cstr; *s; s++){
-            switch(*s){
-            case '"':
-            case '\n':
-            case '\\':
-                num_special_characters++;
-            }
-        }
+        smh_buffer_reserve(buffer, string->length * 2 + 2);
 
-        char *result = malloc(strlen(string->cstr) + num_special_characters + 2 + 1);
-        size_t length = 0;
+        char *result = buffer->data;
+        size_t length = buffer->length;
+        const char *end = string->cstr + string->length;
 
         result[length++] = '"';
 
-        for(char *s = string->cstr; *s; s++){
+        for(const char *s = string->cstr; s != end; s++){
             switch(*s){
             case '"':
                 result[length++] = '\\';
@@ -589,93 +5333,403 @@ const char *smh_failure_str(struct smh_failure *failure){
 
         result[length++] = '"';
         result[length] = '\0';
-        return result;
+        buffer->length = length;
     }
 
-    char *smh_array_json(struct smh_array *array){
-        char *result = malloc(16);
-        size_t length = 0;
+    static void smh_buffer_append_indentation(struct smh_buffer *buffer, size_t depth){
+        smh_buffer_reserve(buffer, 1 + depth * 2);
+        buffer->data[buffer->length++] = '\n';
+        memset(&buffer->data[buffer->length], ' ', depth * 2);
+        buffer->length += depth * 2;
+        buffer->data[buffer->length] = '\0';
+    }
 
-        result[length++] = '[';
+    static bool smh_buffer_flush(struct smh_buffer *buffer, const struct smh_writer *writer){
+        bool ok = buffer->length == 0 || writer->write(writer->user, buffer->data, buffer->length);
+        buffer->length = 0;
+        return ok;
+    }
 
-        for(size_t i = 0; i < array->length; i++){
-            char *element_json = smh_dict_json(&array->items[i]);
-            size_t element_json_length = strlen(element_json);
+    // Output is handed to 'writer' in chunks when given, otherwise it all stays in the buffer
+    static bool smh_buffer_append_json(struct smh_buffer *buffer, struct smh_dict *dict, enum smh_json_format format, const struct smh_writer *writer){
+        const char *item_separator = format == SMH_JSON_DEFAULT ? ", " : ",";
+        const char *key_separator = format == SMH_JSON_COMPACT ? ":" : ": ";
+        size_t item_separator_length = strlen(item_separator);
+        size_t key_separator_length = strlen(key_separator);
+
+        struct smh_walk walk;
+        struct smh_walk_step step;
+        size_t depth = 0;
+        bool ok = true;
+
+        smh_walk_create(&walk, dict);
+
+        while(ok && smh_walk_next(&walk, &step)){
+            if(step.event == SMH_WALK_END){
+                bool empty = step.dict->kind == SMH_DICT_ARRAY ? step.dict->as_array.length == 0 : step.dict->as_object.length == 0;
+                depth--;
+
+                if(format == SMH_JSON_PRETTY && !empty){
+                    smh_buffer_append_indentation(buffer, depth);
+                }
+
+                smh_buffer_append(buffer, step.dict->kind == SMH_DICT_ARRAY ? "]" : "}", 1);
+            } else {
+                if(step.position != 0){
+                    smh_buffer_append(buffer, item_separator, item_separator_length);
+                }
+
+                if(format == SMH_JSON_PRETTY && depth != 0){
+                    smh_buffer_append_indentation(buffer, depth);
+                }
+
+                if(step.key){
+                    smh_buffer_append_json_string(buffer, step.key);
+                    smh_buffer_append(buffer, key_separator, key_separator_length);
+                }
+
+                switch(step.dict->kind){
+                case SMH_DICT_STRING:
+                    smh_buffer_append_json_string(buffer, &step.dict->as_string);
+                    break;
+                case SMH_DICT_ARRAY:
+                    smh_buffer_append(buffer, "[", 1);
+                    depth++;
+                    break;
+                case SMH_DICT_OBJECT:
+                    smh_buffer_append(buffer, "{", 1);
+                    depth++;
+                    break;
+                }
+            }
+
+            if(writer && buffer->length >= SMH_WRITER_CHUNK_SIZE){
+                ok = smh_buffer_flush(buffer, writer);
+            }
+        }
+
+        smh_walk_free(&walk);
+        return ok && (writer == NULL || smh_buffer_flush(buffer, writer));
+    }
+
+    void smh_dict_json_append(struct smh_buffer *buffer, struct smh_dict *dict, enum smh_json_format format){
+        smh_buffer_append_json(buffer, dict, format, NULL);
+    }
+
+    bool smh_dict_json_write(struct smh_dict *dict, enum smh_json_format format, const struct smh_writer *writer){
+        struct smh_buffer buffer = {0};
+        smh_buffer_reserve(&buffer, SMH_WRITER_CHUNK_SIZE);
+
+        bool ok = smh_buffer_append_json(&buffer, dict, format, writer);
+        smh_free(buffer.data);
+        return ok;
+    }
+
+    static bool smh_file_write(void *user, const char *data, size_t length){
+        return fwrite(data, 1, length, (FILE*) user) == length;
+    }
 
-            result = realloc(result, length + 2 + element_json_length + 1);
+    bool smh_dict_json_file(struct smh_dict *dict, enum smh_json_format format, FILE *file){
+        struct smh_writer writer = { smh_file_write, file };
+        return smh_dict_json_write(dict, format, &writer);
+    }
+
+    #if defined(__unix__) || defined(__APPLE__)
+        static bool smh_fd_write(void *user, const char *data, size_t length){
+            int fd = *(int*) user;
+
+            while(length != 0){
+                ssize_t written = write(fd, data, length);
+
+                if(written < 0){
+                    if(errno == EINTR) continue;
+                    return false;
+                }
 
-            if(i != 0){
-                result[length++] = ',';
-                result[length++] = ' ';
+                data += written;
+                length -= written;
             }
 
-            memcpy(&result[length], element_json, element_json_length);
-            length += element_json_length;
-            
-            free(element_json);
+            return true;
         }
 
-        result = realloc(result, length + 2);
-        result[length++] = ']';
-        result[length] = '\0';
-        return result;
+        bool smh_dict_json_fd(struct smh_dict *dict, enum smh_json_format format, int fd){
+            struct smh_writer writer = { smh_fd_write, &fd };
+            return smh_dict_json_write(dict, format, &writer);
+        }
+    #endif
+
+    char *smh_dict_json(struct smh_dict *dict){
+        struct smh_buffer buffer = {0};
+        smh_buffer_append_json(&buffer, dict, SMH_JSON_DEFAULT, NULL);
+        return buffer.data;
+    }
+
+    char *smh_string_json(struct smh_string *string){
+        struct smh_buffer buffer = {0};
+        smh_buffer_append_json_string(&buffer, string);
+        return buffer.data;
+    }
+
+    char *smh_array_json(struct smh_array *array){
+        struct smh_dict dict = smh_dict_array(array->items, array->length);
+        return smh_dict_json(&dict);
     }
 
     char *smh_object_json(struct smh_object *object){
-        char *result = malloc(32);
-        size_t length = 0;
+        struct smh_dict dict = smh_dict_object(object->keys, object->values, object->length);
+        return smh_dict_json(&dict);
+    }
 
-        result[length++] = '{';
+    // The layout of each open container decides how its children are written
+    enum smh_emit_layout {
+        SMH_EMIT_BULLETS,
+        SMH_EMIT_BRACKETS,
+        SMH_EMIT_MAP,
+        SMH_EMIT_MAP_INLINE, // Map whose first entry shares the line of its bullet
+    };
 
-        for(size_t i = 0; i < object->length; i++){
-            char *key = smh_string_json(&object->keys[i]);
-            char *value_json = smh_dict_json(&object->values[i]);
+    struct smh_emit_frame {
+        enum smh_emit_layout layout;
+        size_t level;
+
+        // Bullet arrays nested directly in bullet arrays begin on the next line, where
+        // indentation counts from the level of the enclosing bullet
+        bool nested;
+    };
 
-            size_t key_length = strlen(key);
-            size_t value_json_length = strlen(value_json);
+    struct smh_emitter {
+        struct smh_buffer *buffer;
+        struct smh_emit_frame *frames;
+        size_t depth;
+        size_t capacity;
+        bool started;
+        struct smh_emit_frame inline_frames[SMH_PARSER_INLINE_FRAMES];
+    };
 
-            result = realloc(result, length + key_length + 2 + value_json_length + 2 + 1);
+    static void smh_emitter_push(struct smh_emitter *emitter, enum smh_emit_layout layout, size_t level, bool nested){
+        if(emitter->depth == emitter->capacity){
+            emitter->capacity *= 2;
 
-            if(i != 0){
-                result[length++] = ',';
-                result[length++] = ' ';
+            if(emitter->frames == emitter->inline_frames){
+                emitter->frames = smh_malloc(sizeof *emitter->frames * emitter->capacity);
+                memcpy(emitter->frames, emitter->inline_frames, sizeof emitter->inline_frames);
+            } else {
+                emitter->frames = smh_realloc(emitter->frames, sizeof *emitter->frames * emitter->capacity);
             }
+        }
+
+        emitter->frames[emitter->depth].layout = layout;
+        emitter->frames[emitter->depth].level = level;
+        emitter->frames[emitter->depth].nested = nested;
+        emitter->depth++;
+    }
 
-            memcpy(&result[length], key, key_length);
-            length += key_length;
+    static void smh_emitter_line(struct smh_emitter *emitter, size_t level){
+        if(emitter->started){
+            smh_buffer_append_indentation(emitter->buffer, level);
+        } else {
+            smh_buffer_reserve(emitter->buffer, level * 2);
+            memset(&emitter->buffer->data[emitter->buffer->length], ' ', level * 2);
+            emitter->buffer->length += level * 2;
+            emitter->buffer->data[emitter->buffer->length] = '\0';
+            emitter->started = true;
+        }
+    }
+
+    // Whether a string has to be quoted to be read back as itself, 'bracketed' strings
+    // are items of bracket arrays and end at commas instead of colons
+    static bool smh_string_needs_quotes(const struct smh_string *string, bool bracketed){
+        const char *s = string->cstr;
+        size_t length = string->length;
 
-            result[length++] = ':';
-            result[length++] = ' ';
+        if(length == 0 || s[0] == ' ' || s[0] == '\t' || s[0] == '"' || s[0] == '[' || s[length - 1] == ' '){
+            return true;
+        }
 
-            memcpy(&result[length], value_json, value_json_length);
-            length += value_json_length;
+        if(s[0] == '-' && length > 1 && s[1] == ' '){
+            return true;
+        }
 
-            free(key);
-            free(value_json);
+        for(size_t i = 0; i < length; i++){
+            if(s[i] == '\n') return true;
+            if(bracketed ? s[i] == ',' || s[i] == ']' : s[i] == ':') return true;
         }
 
-        result = realloc(result, length + 2);
-        result[length++] = '}';
-        result[length] = '\0';
-        return result;
+        return false;
+    }
+
+    static bool smh_key_is_expressible(const struct smh_string *key){
+        const char *s = key->cstr;
+        size_t length = key->length;
+
+        if(length != 0 && (s[0] == ' ' || s[0] == '\t' || s[0] == '"' || s[0] == '[')) return false;
+        if(length > 1 && s[0] == '-' && s[1] == ' ') return false;
+
+        return memchr(s, ':', length) == NULL && memchr(s, '\n', length) == NULL;
+    }
+
+    static void smh_emitter_string(struct smh_emitter *emitter, const struct smh_string *string, bool bracketed){
+        // Quoted SMH strings have the same three escapes as JSON strings
+        if(smh_string_needs_quotes(string, bracketed)){
+            smh_buffer_append_json_string(emitter->buffer, string);
+        } else {
+            smh_buffer_append(emitter->buffer, string->cstr, string->length);
+        }
+    }
+
+    static bool smh_array_is_flat(const struct smh_array *array){
+        for(size_t i = 0; i < array->length; i++){
+            if(array->items[i].kind != SMH_DICT_STRING) return false;
+        }
+
+        return true;
+    }
+
+    // Arrays of only strings nested in arrays are written in brackets, since a bullet array
+    // starting on the line of another's bullet would be mistaken for a continuation of it
+    static bool smh_buffer_append_smh(struct smh_buffer *buffer, struct smh_dict *dict, const struct smh_writer *writer){
+        size_t start = buffer->length;
+
+        struct smh_emitter emitter = {
+            .buffer = buffer,
+            .capacity = SMH_PARSER_INLINE_FRAMES,
+        };
+
+        emitter.frames = emitter.inline_frames;
+
+        struct smh_walk walk;
+        struct smh_walk_step step;
+        bool ok = true;
+
+        smh_walk_create(&walk, dict);
+
+        while(ok && smh_walk_next(&walk, &step)){
+            if(step.event == SMH_WALK_END){
+                if(emitter.frames[--emitter.depth].layout == SMH_EMIT_BRACKETS){
+                    smh_buffer_append(buffer, "]", 1);
+                }
+            } else {
+                struct smh_emit_frame *parent = emitter.depth ? &emitter.frames[emitter.depth - 1] : NULL;
+                enum smh_emit_layout parent_layout = parent ? parent->layout : SMH_EMIT_MAP;
+                size_t level = 0;
+                bool in_array = false;
+
+                if(parent == NULL){
+                    // Root values begin the first line
+                } else if(parent_layout == SMH_EMIT_BRACKETS){
+                    if(step.position != 0) smh_buffer_append(buffer, ", ", 2);
+                } else if(parent_layout == SMH_EMIT_BULLETS){
+                    smh_emitter_line(&emitter, parent->nested && step.position == 0 ? 1 : parent->level);
+                    smh_buffer_append(buffer, "- ", 2);
+                    level = parent->level + 1;
+                    in_array = true;
+                } else {
+                    if(!smh_key_is_expressible(step.key)){
+                        ok = false;
+                        break;
+                    }
+
+                    if(step.position != 0 || parent_layout != SMH_EMIT_MAP_INLINE){
+                        smh_emitter_line(&emitter, parent->level);
+                    }
+
+                    smh_buffer_append(buffer, step.key->cstr, step.key->length);
+                    smh_buffer_append(buffer, ":", 1);
+                    if(step.dict->kind == SMH_DICT_STRING || (step.dict->kind == SMH_DICT_ARRAY && step.dict->as_array.length == 0)){
+                        smh_buffer_append(buffer, " ", 1);
+                    }
+                    level = parent->level + 1;
+                }
+
+                switch(step.dict->kind){
+                case SMH_DICT_STRING:
+                    smh_emitter_string(&emitter, &step.dict->as_string, parent_layout == SMH_EMIT_BRACKETS);
+                    break;
+                case SMH_DICT_ARRAY:
+                    if(step.dict->as_array.length == 0 || (in_array && smh_array_is_flat(&step.dict->as_array))){
+                        smh_buffer_append(buffer, "[", 1);
+                        smh_emitter_push(&emitter, SMH_EMIT_BRACKETS, level, false);
+                    } else {
+                        smh_emitter_push(&emitter, SMH_EMIT_BULLETS, level, in_array);
+                    }
+                    break;
+                case SMH_DICT_OBJECT:
+                    // There is no way to write an empty map
+                    ok = step.dict->as_object.length != 0;
+                    smh_emitter_push(&emitter, in_array ? SMH_EMIT_MAP_INLINE : SMH_EMIT_MAP, level, false);
+                    break;
+                }
+            }
+
+            if(writer && buffer->length >= SMH_WRITER_CHUNK_SIZE){
+                ok = ok && smh_buffer_flush(buffer, writer);
+            }
+        }
+
+        smh_walk_free(&walk);
+        if(emitter.frames != emitter.inline_frames) smh_free(emitter.frames);
+
+        // Refused documents are taken back out, rather than left half written
+        if(!ok){
+            buffer->length = start;
+            if(buffer->data) buffer->data[start] = '\0';
+            return false;
+        }
+
+        smh_buffer_append(buffer, "\n", 1);
+        return writer == NULL || smh_buffer_flush(buffer, writer);
+    }
+
+    bool smh_dict_smh_append(struct smh_buffer *buffer, struct smh_dict *dict){
+        return smh_buffer_append_smh(buffer, dict, NULL);
+    }
+
+    bool smh_dict_smh_write(struct smh_dict *dict, const struct smh_writer *writer){
+        struct smh_buffer buffer = {0};
+        smh_buffer_reserve(&buffer, SMH_WRITER_CHUNK_SIZE);
+
+        bool ok = smh_buffer_append_smh(&buffer, dict, writer);
+        smh_free(buffer.data);
+        return ok;
+    }
+
+    bool smh_dict_smh_file(struct smh_dict *dict, FILE *file){
+        struct smh_writer writer = { smh_file_write, file };
+        return smh_dict_smh_write(dict, &writer);
+    }
+
+    #if defined(__unix__) || defined(__APPLE__)
+        bool smh_dict_smh_fd(struct smh_dict *dict, int fd){
+            struct smh_writer writer = { smh_fd_write, &fd };
+            return smh_dict_smh_write(dict, &writer);
+        }
+    #endif
+
+    char *smh_dict_smh(struct smh_dict *dict){
+        struct smh_buffer buffer = {0};
+
+        if(!smh_buffer_append_smh(&buffer, dict, NULL)){
+            smh_free(buffer.data);
+            return NULL;
+        }
+
+        return buffer.data;
     }
 
     char *smh_result_str(struct smh_result *result){
-        if(result->ok){
-            char *json = smh_dict_json(&result->as_success);
-            char *message = malloc(32 + strlen(json) + 1);
-            message[0] = '\0';
+        struct smh_buffer buffer = {0};
 
-            strcat(message, "smh-result-success :: ");
-            strcat(message, json);
-            return message;
+        if(result->ok){
+            smh_buffer_append(&buffer, "smh-result-success :: ", 22);
+            smh_buffer_append_json(&buffer, &result->as_success, SMH_JSON_DEFAULT, NULL);
         } else {
             const char *error = smh_failure_str(&result->as_failure);
-            char *message = malloc(32 + strlen(error) + 1);
-            strcat(message, "smh-result-failure :: ");
-            strcat(message, error);
-            return message;
+            smh_buffer_append(&buffer, "smh-result-failure :: ", 22);
+            smh_buffer_append(&buffer, error, strlen(error));
         }
+
+        return buffer.data;
     }
 
 #endif // SMH_PARSER_NO_HELPERS
@@ -1,10 +1,16 @@
 
 #define SMH_PARSER_IMPLEMENTATION
+#define SMH_PARSER_THREAD_MIN_LENGTH 1
 #include "smh.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__linux__)
+    #include <unistd.h>
+#endif
 
 struct test_case {
     const char *name;
@@ -23,6 +29,11 @@ struct test_case tests[] = {
         .input = "This is a string",
         .expected = "\"This is a string\""
     },
+    (struct test_case){
+        .name = "string literal over lines that look like bullets",
+        .input = "- a\n- \"b\n- c\n- d\n- e\"\n- f\n",
+        .expected = "[\"a\", \"b\\n- c\\n- d\\n- e\", \"f\"]"
+    },
     (struct test_case){
         .name = "string literal over newline",
         .input = "\"This is a very\nlong string that goes over\n multiple lines\"",
@@ -345,33 +356,1295 @@ struct test_case tests[] = {
     (struct test_case){0}
 };
 
-int main(){
-    for(struct test_case *test = tests; test->input; test++){
-        struct smh_result result = smh_parse(test->input);
-        char *json;
+enum test_mode {
+    TEST_MODE_DEFAULT,
+    TEST_MODE_ARENA,
+    TEST_MODE_BORROW,
+    TEST_MODE_LENGTH,
+    TEST_MODE_FILE,
+    TEST_MODE_INDEXED,
+    TEST_MODE_EVENTS,
+    TEST_MODE_PUSH,
+    TEST_MODE_TAPE,
+    TEST_MODE_VALIDATE,
+    TEST_MODE_EMIT,
+    TEST_MODE_SYMBOLS,
+#ifdef SMH_PARSER_THREADS
+    TEST_MODE_THREADS,
+    TEST_MODE_THREADS_ARENA,
+#endif
+    TEST_MODE_COUNT,
+};
 
-        if(result.ok){
-            json = smh_dict_json(&result.as_success);
-        } else {
-            json = strcat(strcat(calloc(64, 1), "error - "), smh_failure_str(&result.as_failure));
+const char *test_mode_names[] = {
+    "default",
+    "arena",
+    "borrow",
+    "length",
+    "file",
+    "indexed",
+    "events",
+    "push",
+    "tape",
+    "validate",
+    "emit",
+    "symbols",
+#ifdef SMH_PARSER_THREADS
+    "threads",
+    "threads arena",
+#endif
+};
+
+struct smh_arena arena;
+struct smh_symbols *symbols;
+
+struct smh_result test_parse(const char *input, enum test_mode mode){
+    switch(mode){
+    case TEST_MODE_ARENA:
+        smh_arena_reset(&arena);
+        return smh_parse_arena(input, &arena);
+    case TEST_MODE_BORROW:
+        return smh_parse_ex(input, &(struct smh_options){ .borrow_strings = true });
+    case TEST_MODE_LENGTH: {
+            // Parse from an exact-size copy without a null-terminator
+            size_t length = strlen(input);
+            char *data = malloc(length ? length : 1);
+            memcpy(data, input, length);
+
+            struct smh_result result = smh_parse_n(data, length);
+            free(data);
+            return result;
+        }
+    case TEST_MODE_FILE: {
+            const char *path = "smh_test_input.smh";
+            FILE *stream = fopen(path, "wb");
+            fputs(input, stream);
+            fclose(stream);
+
+            struct smh_file file;
+            struct smh_result result = smh_parse_file(path, &file);
+            if(result.ok) smh_file_free(&file);
+
+            remove(path);
+            return result;
+        }
+    case TEST_MODE_INDEXED:
+        return smh_parse_with(input, strlen(input), &(struct smh_options){0}, true);
+    case TEST_MODE_SYMBOLS:
+        return smh_parse_ex(input, &(struct smh_options){ .symbols = symbols, .intern_values = 16 });
+#ifdef SMH_PARSER_THREADS
+    case TEST_MODE_THREADS:
+        return smh_parse_ex(input, &(struct smh_options){ .threads = 4 });
+    case TEST_MODE_THREADS_ARENA:
+        smh_arena_reset(&arena);
+        return smh_parse_ex(input, &(struct smh_options){ .arena = &arena, .threads = 3 });
+#endif
+    default:
+        return smh_parse(input);
+    }
+}
+
+// Results are freed with free, while strings made by the library need smh_free
+char *test_copy(char *string){
+    char *copy = strcpy(malloc(strlen(string) + 1), string);
+    smh_free(string);
+    return copy;
+}
+
+char *test_error(enum smh_errorcode errorcode){
+    struct smh_failure failure = { .errorcode = errorcode };
+    return strcat(strcat(calloc(64, 1), "error - "), smh_failure_str(&failure));
+}
+
+// Writes JSON straight from parser events
+struct test_events {
+    char json[4096];
+    size_t length;
+    size_t depth;
+    bool first[64];
+    bool after_key;
+};
+
+void test_events_append(struct test_events *events, const char *text, size_t length){
+    memcpy(&events->json[events->length], text, length);
+    events->length += length;
+}
+
+void test_events_item(struct test_events *events){
+    if(events->after_key){
+        events->after_key = false;
+        return;
+    }
+
+    if(events->depth && !events->first[events->depth]){
+        test_events_append(events, ", ", 2);
+    }
+
+    events->first[events->depth] = false;
+}
+
+void test_events_quoted(struct test_events *events, const char *data, size_t length){
+    test_events_append(events, "\"", 1);
+
+    for(size_t i = 0; i < length; i++){
+        switch(data[i]){
+        case '"':  test_events_append(events, "\\\"", 2); break;
+        case '\n': test_events_append(events, "\\n", 2); break;
+        case '\\': test_events_append(events, "\\\\", 2); break;
+        default:   test_events_append(events, &data[i], 1);
+        }
+    }
+
+    test_events_append(events, "\"", 1);
+}
+
+bool test_events_begin(struct test_events *events, const char *bracket){
+    test_events_item(events);
+    test_events_append(events, bracket, 1);
+    events->first[++events->depth] = true;
+    return true;
+}
+
+bool test_events_end(struct test_events *events, const char *bracket){
+    events->depth--;
+    test_events_append(events, bracket, 1);
+    return true;
+}
+
+bool test_events_begin_array(void *user){ return test_events_begin(user, "["); }
+bool test_events_end_array(void *user){ return test_events_end(user, "]"); }
+bool test_events_begin_object(void *user){ return test_events_begin(user, "{"); }
+bool test_events_end_object(void *user){ return test_events_end(user, "}"); }
+
+bool test_events_key(void *user, const char *data, size_t length){
+    test_events_item(user);
+    test_events_quoted(user, data, length);
+    test_events_append(user, ": ", 2);
+    ((struct test_events*) user)->after_key = true;
+    return true;
+}
+
+bool test_events_string(void *user, const char *data, size_t length){
+    test_events_item(user);
+    test_events_quoted(user, data, length);
+    return true;
+}
+
+// Collects the top-level items handed over by a push parser
+struct test_push {
+    char json[4096];
+    size_t length;
+    size_t count;
+};
+
+bool test_push_item(void *user, const struct smh_string *key, struct smh_dict *value){
+    struct test_push *push = user;
+
+    if(push->count++){
+        memcpy(&push->json[push->length], ", ", 2);
+        push->length += 2;
+    }
+
+    if(key){
+        char *key_json = smh_string_json((struct smh_string*) key);
+        push->length += sprintf(&push->json[push->length], "%s: ", key_json);
+        smh_free(key_json);
+    }
+
+    char *value_json = smh_dict_json(value);
+    push->length += sprintf(&push->json[push->length], "%s", value_json);
+    smh_free(value_json);
+    return true;
+}
+
+// Feeds the input one byte at a time, and wraps the items the same way the expected document is
+char *test_push_json(const char *input, const char *expected){
+    struct test_push push = {0};
+    struct smh_push_parser *parser = smh_push_parser_create(test_push_item, &push);
+    enum smh_errorcode errorcode = SMH_ERRORCODE_NONE;
+
+    for(const char *c = input; *c && !errorcode; c++){
+        errorcode = smh_push_parser_feed(parser, c, 1);
+    }
+
+    enum smh_errorcode finished = smh_push_parser_finish(parser);
+    if(!errorcode) errorcode = finished;
+
+    smh_push_parser_free(parser);
+
+    if(errorcode) return test_error(errorcode);
+
+    char *json = malloc(push.length + 3);
+    size_t length = 0;
+
+    if(expected[0] == '[' || expected[0] == '{') json[length++] = expected[0];
+    memcpy(&json[length], push.json, push.length);
+    length += push.length;
+    if(expected[0] == '[') json[length++] = ']';
+    if(expected[0] == '{') json[length++] = '}';
+
+    json[length] = '\0';
+    return json;
+}
+
+// Writes JSON by walking a tape with its accessors
+void test_tape_walk(struct test_events *events, const struct smh_tape *tape, size_t node){
+    size_t key_length;
+    const char *key = smh_tape_key(tape, node, &key_length);
+    if(key) test_events_key(events, key, key_length);
+
+    if(smh_tape_kind(tape, node) == SMH_DICT_STRING){
+        test_events_string(events, smh_tape_string(tape, node), smh_tape_length(tape, node));
+        return;
+    }
+
+    bool array = smh_tape_kind(tape, node) == SMH_DICT_ARRAY;
+    test_events_begin(events, array ? "[" : "{");
+
+    struct smh_tape_iterator iterator = smh_tape_iterate(tape, node);
+    size_t child;
+
+    while(smh_tape_iterator_next(&iterator, &child)){
+        test_tape_walk(events, tape, child);
+    }
+
+    test_events_end(events, array ? "]" : "}");
+}
+
+// Round trips through a tape built from events and one built from a document
+char *test_tape_json(const char *input){
+    struct smh_tape tape;
+    enum smh_errorcode errorcode = smh_tape_parse(&tape, input, strlen(input));
+    if(errorcode) return test_error(errorcode);
+
+    struct smh_result parsed = smh_tape_to_dict(&tape, 0);
+    smh_tape_free(&tape);
+
+    smh_tape_from_dict(&tape, &parsed.as_success);
+    smh_result_free(&parsed);
+
+    // Walk a snapshot of the tape instead of the tape itself
+    size_t length;
+    void *snapshot = smh_snapshot_create(&tape, &length);
+    smh_tape_free(&tape);
+
+    errorcode = smh_snapshot_open(&tape, snapshot, length);
+    if(errorcode){
+        smh_free(snapshot);
+        return test_error(errorcode);
+    }
+
+    struct test_events events = {0};
+    test_tape_walk(&events, &tape, 0);
+    smh_free(snapshot);
+
+    char *json = malloc(events.length + 1);
+    memcpy(json, events.json, events.length);
+    json[events.length] = '\0';
+    return json;
+}
+
+// Emits the parsed document as SMH and parses that instead, which has to emit identically
+char *test_emit_json(const char *input){
+    struct smh_result result = smh_parse(input);
+    if(!result.ok) return test_error(result.as_failure.errorcode);
+
+    char *markup = smh_dict_smh(&result.as_success);
+    smh_result_free(&result);
+    if(markup == NULL) return strcpy(malloc(32), "error - unable to emit");
+
+    struct smh_result reparsed = smh_parse(markup);
+    char *json;
+
+    if(reparsed.ok){
+        char *again = smh_dict_smh(&reparsed.as_success);
+        json = again && strcmp(again, markup) == 0 ? test_copy(smh_dict_json(&reparsed.as_success)) : strcpy(malloc(32), "error - unable to emit");
+        smh_free(again);
+        smh_result_free(&reparsed);
+    } else {
+        json = test_error(reparsed.as_failure.errorcode);
+    }
+
+    smh_free(markup);
+    return json;
+}
+
+char *test_json(const char *input, const char *expected, enum test_mode mode){
+    if(mode == TEST_MODE_PUSH){
+        return test_push_json(input, expected);
+    }
+
+    if(mode == TEST_MODE_TAPE){
+        return test_tape_json(input);
+    }
+
+    if(mode == TEST_MODE_EMIT){
+        return test_emit_json(input);
+    }
+
+    // Validation only tells whether the document would parse
+    if(mode == TEST_MODE_VALIDATE){
+        enum smh_errorcode errorcode = smh_validate(input, strlen(input));
+        return errorcode ? test_error(errorcode) : strcpy(malloc(strlen(expected) + 1), expected);
+    }
+
+    if(mode == TEST_MODE_EVENTS){
+        struct test_events events = {0};
+        struct smh_handler handler = {
+            .user = &events,
+            .begin_array = test_events_begin_array,
+            .end_array = test_events_end_array,
+            .begin_object = test_events_begin_object,
+            .key = test_events_key,
+            .string = test_events_string,
+            .end_object = test_events_end_object,
+        };
+
+        enum smh_errorcode errorcode = smh_parse_events(input, strlen(input), &handler);
+        if(errorcode) return test_error(errorcode);
+
+        char *json = malloc(events.length + 1);
+        memcpy(json, events.json, events.length);
+        json[events.length] = '\0';
+        return json;
+    }
+
+    struct smh_result result = test_parse(input, mode);
+
+    if(!result.ok){
+        return test_error(result.as_failure.errorcode);
+    }
+
+    char *json = test_copy(smh_dict_json(&result.as_success));
+    smh_result_free(&result);
+    return json;
+}
+
+// Looks up every key of narrow and wide objects, with and without a precomputed hash
+bool test_object_get(){
+    for(int width = 1; width <= 64; width *= 4){
+        char markup[2048] = "";
+
+        for(int i = 0; i < width; i++){
+            sprintf(&markup[strlen(markup)], "key %d: value %d\n", i, i);
+        }
+
+        strcat(markup, "key 0: duplicate\n");
+
+        struct smh_result result = smh_parse(markup);
+        if(!result.ok) return false;
+
+        struct smh_object *object = &result.as_success.as_object;
+        bool passed = smh_object_get(object, "missing", 7) == NULL;
+
+        for(int i = 0; i < width; i++){
+            char key[32], value[32];
+            sprintf(key, "key %d", i);
+            sprintf(value, "value %d", i);
+
+            struct smh_key hashed = smh_key(key, strlen(key));
+            struct smh_dict *found = smh_object_get(object, key, strlen(key));
+
+            passed = passed && found && found == smh_object_get_key(object, &hashed) && strcmp(found->as_string.cstr, value) == 0;
         }
 
-        bool failed = strcmp(json, test->expected) != 0;
         smh_result_free(&result);
 
+        if(!passed){
+            printf("Test 'object lookup' failed for %d keys!\n", width);
+            return false;
+        }
+    }
+
+    printf("Passed test 'object lookup'\n");
+    return true;
+}
+
+// Nesting is limited by max_depth, and even very deep documents don't need a deep native stack
+bool test_depth_limit(){
+    size_t depth = 100000;
+    char *markup = malloc(depth * 2 + 2);
+
+    for(size_t i = 0; i < depth; i++){
+        markup[i] = '[';
+        markup[depth + 1 + i] = ']';
+    }
+
+    markup[depth] = 'a';
+    markup[depth * 2 + 1] = '\0';
+
+    struct smh_result too_deep = smh_parse(markup);
+    struct smh_result limited = smh_parse_ex(markup, &(struct smh_options){ .max_depth = depth - 1 });
+    struct smh_result deep = smh_parse_ex(markup, &(struct smh_options){ .max_depth = depth });
+
+    bool passed = !too_deep.ok && too_deep.as_failure.errorcode == SMH_ERRORCODE_TOO_DEEP
+               && !limited.ok && limited.as_failure.errorcode == SMH_ERRORCODE_TOO_DEEP
+               && deep.ok;
+
+    if(deep.ok){
+        char *json = smh_dict_json(&deep.as_success);
+        passed = passed && strlen(json) == depth * 2 + 3 && strncmp(&json[depth], "\"a\"]", 4) == 0;
+        smh_free(json);
+        smh_result_free(&deep);
+    }
+
+    struct smh_result bullets = smh_parse_ex("- - - - a", &(struct smh_options){ .max_depth = 3 });
+    passed = passed && !bullets.ok && bullets.as_failure.errorcode == SMH_ERRORCODE_TOO_DEEP;
+
+    free(markup);
+
+    printf(passed ? "Passed test 'depth limit'\n" : "Test 'depth limit' failed!\n");
+    return passed;
+}
+
+struct test_query {
+    const char *path;
+    const char *expected;
+};
+
+// Joins the JSON of every match, or reports malformed paths
+char *test_query_json(struct smh_dict *document, const char *path){
+    struct smh_query *query = smh_query_compile(path);
+    if(query == NULL) return strcpy(malloc(16), "malformed");
+
+    struct smh_dict *matches[16];
+    size_t count = smh_query_all(query, document, matches, 16);
+    char *json = calloc(1024, 1);
+
+    for(size_t i = 0; i < count; i++){
+        char *match_json = smh_dict_json(matches[i]);
+        if(i) strcat(json, " | ");
+        strcat(json, match_json);
+        smh_free(match_json);
+    }
+
+    if(count && smh_query_first(query, document) != matches[0]){
+        strcpy(json, "first match differs");
+    }
+
+    smh_query_free(query);
+    return json;
+}
+
+bool test_queries(){
+    const char *markup = "\
+servers:\n\
+- name: alpha\n\
+  limits:\n\
+    memory: 512\n\
+- name: beta\n\
+  limits:\n\
+    memory: 1024\n\
+    disk: 20\n\
+admins: [root, ops]\n\
+";
+
+    struct test_query queries[] = {
+        { "", "{\"servers\": [{\"name\": \"alpha\", \"limits\": {\"memory\": \"512\"}}, {\"name\": \"beta\", \"limits\": {\"memory\": \"1024\", \"disk\": \"20\"}}], \"admins\": [\"root\", \"ops\"]}" },
+        { "servers[1].limits.memory", "\"1024\"" },
+        { ".servers[0].name", "\"alpha\"" },
+        { "servers[*].limits.memory", "\"512\" | \"1024\"" },
+        { "servers[*].limits.disk", "\"20\"" },
+        { "servers[1].limits.*", "\"1024\" | \"20\"" },
+        { "admins[*]", "\"root\" | \"ops\"" },
+        { "servers[2].name", "" },
+        { "admins.name", "" },
+        { "servers[", "malformed" },
+        { "servers[0", "malformed" },
+        { "servers[x]", "malformed" },
+        { "servers[18446744073709551617]", "malformed" },
+        { "servers..name", "malformed" },
+        { "servers[0]name", "malformed" },
+    };
+
+    struct smh_result result = smh_parse(markup);
+    if(!result.ok) return false;
+
+    for(size_t i = 0; i < sizeof queries / sizeof *queries; i++){
+        char *json = test_query_json(&result.as_success, queries[i].path);
+        bool failed = strcmp(json, queries[i].expected) != 0;
+
         if(failed){
-            printf("Test '%s' failed!\n", test->name);
-            printf("------ Expected: ------\n%s\n", test->expected);
+            printf("Test 'query %s' failed!\n", queries[i].path);
+            printf("------ Expected: ------\n%s\n", queries[i].expected);
             printf("------- Actual: -------\n%s\n", json);
-            free(json);
-            return 1;
+        } else {
+            printf("Passed test 'query %s'\n", queries[i].path);
         }
 
         free(json);
 
-        printf("Passed test '%s'\n", test->name);
+        if(failed){
+            smh_result_free(&result);
+            return false;
+        }
     }
 
+    smh_result_free(&result);
+    return true;
+}
+
+bool test_json_writer(void *user, const char *data, size_t length){
+    smh_dict_json_append(user, &(struct smh_dict){ .kind = SMH_DICT_STRING, .as_string = { (char*) data, length } }, SMH_JSON_COMPACT);
+    return true;
+}
+
+// Serializes the same document in every format and to every kind of output
+bool test_json_formats(){
+    struct smh_result result = smh_parse("name: Isaac\nlist:\n  - a\n  - [b, c]\nempty: []\n");
+    bool passed = result.ok;
+
+    if(result.ok){
+        struct smh_buffer buffer = {0};
+        smh_dict_json_append(&buffer, &result.as_success, SMH_JSON_COMPACT);
+        passed = passed && strcmp(buffer.data, "{\"name\":\"Isaac\",\"list\":[\"a\",[\"b\",\"c\"]],\"empty\":[]}") == 0;
+
+        buffer.length = 0;
+        smh_dict_json_append(&buffer, &result.as_success, SMH_JSON_PRETTY);
+        passed = passed && strcmp(buffer.data,
+            "{\n"
+            "  \"name\": \"Isaac\",\n"
+            "  \"list\": [\n"
+            "    \"a\",\n"
+            "    [\n"
+            "      \"b\",\n"
+            "      \"c\"\n"
+            "    ]\n"
+            "  ],\n"
+            "  \"empty\": []\n"
+            "}") == 0;
+
+        // Each piece handed to the writer comes back as a compact JSON string
+        struct smh_buffer pieces = {0};
+        struct smh_writer writer = { test_json_writer, &pieces };
+        passed = passed && smh_dict_json_write(&result.as_success, SMH_JSON_DEFAULT, &writer);
+        passed = passed && strcmp(pieces.data, "\"{\\\"name\\\": \\\"Isaac\\\", \\\"list\\\": [\\\"a\\\", [\\\"b\\\", \\\"c\\\"]], \\\"empty\\\": []}\"") == 0;
+
+        FILE *file = tmpfile();
+        char contents[128] = "";
+        passed = passed && file && smh_dict_json_file(&result.as_success, SMH_JSON_COMPACT, file);
+
+        if(file){
+            rewind(file);
+            contents[fread(contents, 1, sizeof contents - 1, file)] = '\0';
+            fclose(file);
+        }
+
+        buffer.length = 0;
+        smh_dict_json_append(&buffer, &result.as_success, SMH_JSON_COMPACT);
+        passed = passed && strcmp(contents, buffer.data) == 0;
+
+        smh_free(pieces.data);
+        smh_free(buffer.data);
+        smh_result_free(&result);
+    }
+
+    struct smh_result failure = smh_parse("\"unterminated");
+    char *message = smh_result_str(&failure);
+    passed = passed && strcmp(message, "smh-result-failure :: unterminated construct") == 0;
+    smh_free(message);
+
+    printf(passed ? "Passed test 'json formats'\n" : "Test 'json formats' failed!\n");
+    return passed;
+}
+
+// Emits canonical SMH, and refuses documents that SMH can't express
+bool test_emit(){
+    struct smh_result result = smh_parse("name: Isaac\nlist:\n- a\n- [b, \"c, d\"]\n- x: \"1\"\n  y: -\nempty: []\n");
+    bool passed = result.ok;
+
+    if(result.ok){
+        char *markup = smh_dict_smh(&result.as_success);
+        passed = passed && markup && strcmp(markup,
+            "name: Isaac\n"
+            "list:\n"
+            "  - a\n"
+            "  - [b, \"c, d\"]\n"
+            "  - x: 1\n"
+            "    y: -\n"
+            "empty: []\n") == 0;
+        smh_free(markup);
+        smh_result_free(&result);
+    }
+
+    struct smh_dict empty = { .kind = SMH_DICT_OBJECT };
+    struct smh_string key = { "- a", 3, SMH_STRING_BORROWED };
+    struct smh_dict unkeyable = { .kind = SMH_DICT_OBJECT, .as_object = { &key, &empty, 1 } };
+
+    passed = passed && smh_dict_smh(&empty) == NULL && smh_dict_smh(&unkeyable) == NULL;
+
+    // A document refused partway through leaves what was already in the buffer untouched
+    struct smh_string keys[] = { { "a", 1, SMH_STRING_BORROWED }, { "b", 1, SMH_STRING_BORROWED } };
+    struct smh_dict values[] = { { .kind = SMH_DICT_STRING, .as_string = { "x", 1, SMH_STRING_BORROWED } }, empty };
+    struct smh_dict partial = { .kind = SMH_DICT_OBJECT, .as_object = { keys, values, 2 } };
+    struct smh_buffer buffer = {0};
+
+    passed = passed && smh_dict_smh_append(&buffer, &values[0]) && !smh_dict_smh_append(&buffer, &partial)
+          && buffer.length == 2 && strcmp(buffer.data, "x\n") == 0;
+    smh_free(buffer.data);
+
+    printf(passed ? "Passed test 'emit'\n" : "Test 'emit' failed!\n");
+    return passed;
+}
+
+// Loads a snapshot from a file, and rejects damaged ones
+bool test_snapshot(){
+    const char *markup = "- name: Isaac\n  tags: [a, b]\n- name: Joe\n";
+    const char *path = "test_snapshot.bin";
+    struct smh_tape tape;
+    size_t length;
+
+    if(smh_tape_parse(&tape, markup, strlen(markup))) return false;
+    char *snapshot = smh_snapshot_create(&tape, &length);
+    smh_tape_free(&tape);
+
+    FILE *file = fopen(path, "wb");
+    bool passed = file && fwrite(snapshot, 1, length, file) == length;
+    if(file) fclose(file);
+
+    struct smh_file mapping;
+    passed = passed && smh_snapshot_load(&tape, path, &mapping) == SMH_ERRORCODE_NONE;
+    remove(path);
+
+    if(passed){
+        struct smh_result result = smh_tape_to_dict(&tape, 0);
+        char *json = smh_dict_json(&result.as_success);
+        passed = strcmp(json, "[{\"name\": \"Isaac\", \"tags\": [\"a\", \"b\"]}, {\"name\": \"Joe\"}]") == 0;
+        smh_free(json);
+        smh_result_free(&result);
+        smh_file_free(&mapping);
+    }
+
+    // Flipping any single byte, or cutting the snapshot short, has to be noticed
+    for(size_t i = 0; i < length; i++){
+        snapshot[i] ^= 0x20;
+        passed = passed && smh_snapshot_open(&tape, snapshot, length) == SMH_ERRORCODE_BAD_SNAPSHOT;
+        snapshot[i] ^= 0x20;
+    }
+
+    passed = passed && smh_snapshot_open(&tape, snapshot, length - 1) == SMH_ERRORCODE_BAD_SNAPSHOT;
+    passed = passed && smh_snapshot_open(&tape, snapshot, length) == SMH_ERRORCODE_NONE;
+    smh_free(snapshot);
+
+    // Snapshots of tampered tapes have valid checksums, so their structure has to be checked
+    for(int tampering = 0; tampering < 4; tampering++){
+        struct smh_tape tampered;
+        if(smh_tape_parse(&tampered, markup, strlen(markup))) return false;
+
+        switch(tampering){
+        case 0: tampered.nodes[4].parent = 1; break;     // 'a' claims its grandparent
+        case 1: tampered.nodes[6].parent = 3; break;     // Joe claims a closed array
+        case 2: tampered.nodes[2].key_length = 1; break;  // Key without its terminator
+        case 3: tampered.nodes[3].length = 1; break;     // Array miscounting its items
+        }
+
+        char *forged = smh_snapshot_create(&tampered, &length);
+        smh_tape_free(&tampered);
+
+        passed = passed && smh_snapshot_open(&tape, forged, length) == SMH_ERRORCODE_BAD_SNAPSHOT;
+        smh_free(forged);
+    }
+
+    printf(passed ? "Passed test 'snapshot'\n" : "Test 'snapshot' failed!\n");
+    return passed;
+}
+
+#ifdef SMH_PARSER_CACHE
+void *test_cache_worker(void *markup){
+    for(int i = 0; i < 1000; i++){
+        struct smh_shared *shared = smh_cache_parse(markup, strlen(markup), NULL);
+        if(shared == NULL || smh_shared_dict(shared)->kind != SMH_DICT_OBJECT) return markup;
+        smh_shared_release(shared);
+    }
+
+    return NULL;
+}
+
+// Shares parsed documents between loads, from several threads at once, and evicts them by memory
+bool test_cache(){
+    const char *markup = "name: Isaac\nage: 100\n";
+    const char *path = "test_cache.smh";
+    enum smh_errorcode errorcode = SMH_ERRORCODE_NONE;
+
+    struct smh_shared *first = smh_cache_parse(markup, strlen(markup), NULL);
+    struct smh_shared *second = smh_cache_parse(markup, strlen(markup), NULL);
+    struct smh_shared *broken = smh_cache_parse("\"unterminated", 13, &errorcode);
+    struct smh_cache_stats stats = smh_cache_get_stats();
+
+    bool passed = first && first == second && broken == NULL && errorcode == SMH_ERRORCODE_UNTERMINATED
+               && stats.hits == 1 && stats.misses == 2 && stats.entries == 1;
+
+    // Markup that only shares a hash with a cached document is parsed on its own
+    const char *colliding[] = {
+        "name: alice_____________________________________________________",
+        "name: alteijytqg________________________bd047td9________________",
+    };
+
+    struct smh_shared *alice = smh_cache_parse(colliding[0], 64, NULL);
+    struct smh_shared *other = smh_cache_parse(colliding[1], 64, NULL);
+
+    passed = passed && alice && other && alice != other
+          && strcmp(smh_object_get(&smh_shared_dict(other)->as_object, "name", 4)->as_string.cstr, colliding[1] + 6) == 0;
+    if(alice) smh_shared_release(alice);
+    if(other) smh_shared_release(other);
+
+    // Documents evicted while still referenced stay usable
+    smh_cache_clear();
+    passed = passed && smh_object_get(&smh_shared_dict(first)->as_object, "age", 3) != NULL;
+    smh_shared_release(first);
+    smh_shared_release(second);
+
+    pthread_t threads[4];
+
+    for(int i = 0; i < 4; i++){
+        pthread_create(&threads[i], NULL, test_cache_worker, (void*) markup);
+    }
+
+    for(int i = 0; i < 4; i++){
+        void *failed;
+        pthread_join(threads[i], &failed);
+        passed = passed && failed == NULL;
+    }
+
+    stats = smh_cache_get_stats();
+    passed = passed && stats.entries == 1 && stats.hits + stats.misses == 4005;
+
+    // Files are parsed again once they change
+    FILE *file = fopen(path, "wb");
+    if(file){
+        fputs("- a\n", file);
+        fclose(file);
+    }
+
+    struct smh_shared *before = smh_cache_parse_file(path, NULL);
+    file = fopen(path, "wb");
+    if(file){
+        fputs("- a\n- b\n", file);
+        fclose(file);
+    }
+
+    struct smh_shared *after = smh_cache_parse_file(path, NULL);
+    remove(path);
+
+    passed = passed && before && after && before != after && smh_shared_dict(after)->as_array.length == 2;
+    if(before) smh_shared_release(before);
+    if(after) smh_shared_release(after);
+
+    // Rewriting a file to the same size within the same second still counts as a change
+    for(int i = 0; i < 2; i++){
+        file = fopen(path, "wb");
+        if(file){
+            fputs(i ? "- b\n" : "- a\n", file);
+            fclose(file);
+        }
+
+        struct smh_shared *shared = smh_cache_parse_file(path, NULL);
+        passed = passed && shared && strcmp(smh_shared_dict(shared)->as_array.items[0].as_string.cstr, i ? "b" : "a") == 0;
+        if(shared) smh_shared_release(shared);
+    }
+
+    remove(path);
+
+    smh_cache_set_limit(0);
+    stats = smh_cache_get_stats();
+    passed = passed && stats.entries == 0 && stats.memory == 0;
+
+    printf(passed ? "Passed test 'cache'\n" : "Test 'cache' failed!\n");
+    return passed;
+}
+#endif
+
+// Edits documents in place, only re-parsing the entries around each edit
+bool test_document(){
+    char markup[16384] = "";
+
+    for(int i = 0; i < 500; i++){
+        sprintf(&markup[strlen(markup)], "- name: person %d\n  age: %d\n", i, i);
+    }
+
+    struct smh_document *document = smh_document_create(markup, strlen(markup));
+    const struct smh_dict *root = smh_document_dict(document);
+    const char *untouched = root->as_array.items[400].as_object.values[0].as_string.cstr;
+
+    // Rename person 10 and add a new person after them
+    size_t offset = strstr(markup, "person 10\n") - markup + 7;
+    bool passed = smh_document_edit(document, offset, 2, "ten", 3) == SMH_ERRORCODE_NONE;
+
+    offset = strstr(markup, "- name: person 11") - markup + 1;
+    passed = passed && smh_document_edit(document, offset, 0, "- name: new\n", 12) == SMH_ERRORCODE_NONE;
+
+    size_t length;
+    const char *edited = smh_document_markup(document, &length);
+    struct smh_result expected = smh_parse_n(edited, length);
+
+    if(expected.ok){
+        char *expected_json = smh_dict_json(&expected.as_success);
+        char *json = smh_dict_json((struct smh_dict*) root);
+
+        passed = passed && strcmp(json, expected_json) == 0 && root->as_array.length == 501;
+        passed = passed && root->as_array.items[401].as_object.values[0].as_string.cstr == untouched;
+
+        smh_free(json);
+        smh_free(expected_json);
+        smh_result_free(&expected);
+    } else {
+        passed = false;
+    }
+
+    // Broken markup keeps the last valid tree until it is fixed
+    passed = passed && smh_document_edit(document, 2, 0, "\"", 1) == SMH_ERRORCODE_UNTERMINATED;
+    passed = passed && smh_document_error(document) == SMH_ERRORCODE_UNTERMINATED && smh_document_dict(document)->as_array.length == 501;
+    passed = passed && smh_document_edit(document, 2, 1, "", 0) == SMH_ERRORCODE_NONE;
+
+    // Turning the first entry into something else parses the document whole
+    passed = passed && smh_document_edit(document, 0, 2, "[", 1) == SMH_ERRORCODE_UNTERMINATED;
+
+    smh_document_markup(document, &length);
+    passed = passed && smh_document_edit(document, 0, length, "[a, b]", 6) == SMH_ERRORCODE_NONE;
+    passed = passed && smh_document_dict(document)->as_array.length == 2;
+
+    smh_document_free(document);
+
+    printf(passed ? "Passed test 'document'\n" : "Test 'document' failed!\n");
+    return passed;
+}
+
+#if defined(__linux__)
+// Pipes have no size and can't be mapped, so they are read until they end
+bool test_file_stream(){
+    int fds[2];
+    if(pipe(fds) != 0) return false;
+
+    const char *markup = "- name: Isaac\n- name: Joe\n";
+    bool passed = write(fds[1], markup, strlen(markup)) == (ssize_t) strlen(markup);
+    close(fds[1]);
+
+    char path[64];
+    sprintf(path, "/dev/fd/%d", fds[0]);
+
+    struct smh_file file;
+    struct smh_result result = smh_parse_file(path, &file);
+    close(fds[0]);
+
+    passed = passed && result.ok && result.as_success.kind == SMH_DICT_ARRAY && result.as_success.as_array.length == 2;
+
+    if(result.ok){
+        smh_result_free(&result);
+        smh_file_free(&file);
+    }
+
+    // Files that claim to be empty may not be
+    passed = passed && smh_file_open(&file, "/proc/self/status") && file.length > 0;
+    smh_file_free(&file);
+
+    printf(passed ? "Passed test 'file stream'\n" : "Test 'file stream' failed!\n");
+    return passed;
+}
+#endif
+
+// Interned keys and short values share one copy across every document parsed with the table
+bool test_symbols(){
+    struct smh_symbols *table = smh_symbols_create();
+    const char *markup = "- name: Isaac\n  role: Author\n- name: Joe\n  role: Author\n  bio: Joe is a contributor\n";
+    struct smh_options options = { .symbols = table, .intern_values = 8 };
+
+    struct smh_result first = smh_parse_ex(markup, &options);
+    struct smh_result second = smh_parse_ex("name: Isaac", &options);
+    bool passed = first.ok && second.ok;
+
+    if(passed){
+        struct smh_array *people = &first.as_success.as_array;
+        const char *name = smh_symbols_find(table, "name", 4);
+
+        passed = name && people->items[0].as_object.keys[0].cstr == name && people->items[1].as_object.keys[0].cstr == name;
+        passed = passed && second.as_success.as_object.keys[0].cstr == name;
+        passed = passed && people->items[0].as_object.keys[0].storage == SMH_STRING_INTERNED;
+
+        // Values no longer than 'intern_values' are interned too
+        struct smh_dict *role = smh_object_get_symbol(&people->items[1].as_object, smh_symbol(table, "role", 4));
+        struct smh_dict *bio = smh_object_get_symbol(&people->items[1].as_object, smh_symbol(table, "bio", 3));
+        passed = passed && role && role->as_string.cstr == smh_symbols_find(table, "Author", 6);
+        passed = passed && bio && bio->as_string.storage != SMH_STRING_INTERNED && strcmp(bio->as_string.cstr, "Joe is a contributor") == 0;
+        passed = passed && smh_object_get_symbol(&people->items[0].as_object, smh_symbol(table, "bio", 3)) == NULL;
+        passed = passed && smh_object_get(&people->items[1].as_object, "role", 4) == role;
+    }
+
+    passed = passed && smh_symbols_find(table, "Joe is a contributor", 20) == NULL;
+    passed = passed && smh_symbols_count(table) == 6;
+
+    // Wide objects are looked up through their index
+    char wide_markup[2048] = "";
+
+    for(int i = 0; i < 64; i++){
+        sprintf(&wide_markup[strlen(wide_markup)], "key %d: value %d\n", i, i);
+    }
+
+    struct smh_result wide = smh_parse_ex(wide_markup, &options);
+    passed = passed && wide.ok && wide.as_success.as_object.index != NULL;
+
+    for(int i = 0; passed && i < 64; i++){
+        char key[16];
+        sprintf(key, "key %d", i);
+
+        struct smh_dict *value = smh_object_get_symbol(&wide.as_success.as_object, smh_symbol(table, key, strlen(key)));
+        passed = value && value == smh_object_get(&wide.as_success.as_object, key, strlen(key));
+    }
+
+    passed = passed && smh_object_get_symbol(&wide.as_success.as_object, smh_symbol(table, "key 64", 6)) == NULL;
+    smh_result_free(&wide);
+
+    // Documents must be freed before the table they were interned into
+    smh_result_free(&first);
+    smh_result_free(&second);
+    smh_symbols_free(table);
+
+    printf(passed ? "Passed test 'symbols'\n" : "Test 'symbols' failed!\n");
+    return passed;
+}
+
+struct test_server {
+    char *host;
+    int port;
+};
+
+struct test_config {
+    char *name;
+    bool verbose;
+    int64_t offset;
+    size_t workers;
+    double ratio;
+    struct test_server primary;
+    struct test_server *servers;
+    size_t servers_length;
+    char **tags;
+    size_t tags_length;
+};
+
+const struct smh_field test_server_fields[] = {
+    { .name = "host", .offset = offsetof(struct test_server, host), .type = SMH_FIELD_STRING, .required = true },
+    { .name = "port", .offset = offsetof(struct test_server, port), .type = SMH_FIELD_INT },
+};
+
+const struct smh_schema test_server_schema = { test_server_fields, 2 };
+
+const struct smh_field test_server_element = { .type = SMH_FIELD_OBJECT, .schema = &test_server_schema };
+const struct smh_field test_tag_element = { .type = SMH_FIELD_STRING };
+
+const struct smh_field test_config_fields[] = {
+    { .name = "name", .offset = offsetof(struct test_config, name), .type = SMH_FIELD_STRING, .required = true },
+    { .name = "verbose", .offset = offsetof(struct test_config, verbose), .type = SMH_FIELD_BOOL },
+    { .name = "offset", .offset = offsetof(struct test_config, offset), .type = SMH_FIELD_INT64 },
+    { .name = "workers", .offset = offsetof(struct test_config, workers), .type = SMH_FIELD_SIZE },
+    { .name = "ratio", .offset = offsetof(struct test_config, ratio), .type = SMH_FIELD_DOUBLE },
+    { .name = "primary", .offset = offsetof(struct test_config, primary), .type = SMH_FIELD_OBJECT, .schema = &test_server_schema },
+    {
+        .name = "servers", .offset = offsetof(struct test_config, servers), .type = SMH_FIELD_ARRAY,
+        .element = &test_server_element, .element_size = sizeof(struct test_server), .count_offset = offsetof(struct test_config, servers_length),
+    },
+    {
+        .name = "tags", .offset = offsetof(struct test_config, tags), .type = SMH_FIELD_ARRAY,
+        .element = &test_tag_element, .element_size = sizeof(char*), .count_offset = offsetof(struct test_config, tags_length),
+    },
+};
+
+const struct smh_schema test_config_schema = { test_config_fields, 8 };
+
+enum smh_errorcode test_decode_config(const char *markup, struct test_config *config, const char **field){
+    *config = (struct test_config){ .workers = 4 };
+    return smh_decode(markup, strlen(markup), &test_config_schema, config, field);
+}
+
+// Maps decode straight into structs, skipping unknown keys and refusing values that don't fit
+bool test_decode(){
+    const char *markup = "name: demo\n"
+                         "verbose: yes\n"
+                         "offset: -9223372036854775808\n"
+                         "ratio: 0.25\n"
+                         "unknown:\n"
+                         "  - nested: [a, b]\n"
+                         "primary:\n"
+                         "  host: localhost\n"
+                         "  port: 80\n"
+                         "servers:\n"
+                         "  - host: a.example\n"
+                         "    port: 8080\n"
+                         "    weight: 2\n"
+                         "  - host: b.example\n"
+                         "tags: [fast, \"small\"]\n";
+
+    struct test_config config;
+    const char *field;
+    bool passed = test_decode_config(markup, &config, &field) == SMH_ERRORCODE_NONE;
+
+    passed = passed && strcmp(config.name, "demo") == 0 && config.verbose && config.offset == INT64_MIN;
+    passed = passed && config.workers == 4 && config.ratio == 0.25;
+    passed = passed && strcmp(config.primary.host, "localhost") == 0 && config.primary.port == 80;
+    passed = passed && config.servers_length == 2 && strcmp(config.servers[1].host, "b.example") == 0;
+    passed = passed && config.servers[0].port == 8080 && config.servers[1].port == 0;
+    passed = passed && config.tags_length == 2 && strcmp(config.tags[1], "small") == 0;
+
+    smh_schema_free(&test_config_schema, &config);
+    passed = passed && config.name == NULL && config.servers == NULL && config.servers_length == 0;
+
+    // Required fields of nested structs are checked too
+    passed = passed && test_decode_config("name: demo\nservers:\n  - port: 1\n", &config, &field) == SMH_ERRORCODE_MISSING_FIELD;
+    passed = passed && strcmp(field, "host") == 0 && config.servers == NULL;
+    passed = passed && test_decode_config("verbose: no\n", &config, &field) == SMH_ERRORCODE_MISSING_FIELD && strcmp(field, "name") == 0;
+
+    // Values are checked against their fields, and whatever was decoded is freed
+    passed = passed && test_decode_config("name: demo\nprimary:\n  host: h\n  port: 99999999999\n", &config, &field) == SMH_ERRORCODE_BAD_VALUE;
+    passed = passed && strcmp(field, "port") == 0 && config.name == NULL && config.primary.host == NULL;
+    passed = passed && test_decode_config("name: demo\nworkers: -1\n", &config, &field) == SMH_ERRORCODE_BAD_VALUE && strcmp(field, "workers") == 0;
+    passed = passed && test_decode_config("name: demo\nverbose: maybe\n", &config, &field) == SMH_ERRORCODE_BAD_VALUE;
+    passed = passed && test_decode_config("name: demo\nratio: 1.5x\n", &config, &field) == SMH_ERRORCODE_BAD_VALUE;
+    passed = passed && test_decode_config("name: [a]\n", &config, &field) == SMH_ERRORCODE_BAD_VALUE && strcmp(field, "name") == 0;
+    passed = passed && test_decode_config("- name\n", &config, &field) == SMH_ERRORCODE_BAD_VALUE && field == NULL;
+    passed = passed && test_decode_config("name: demo\nother: [a\n", &config, &field) == SMH_ERRORCODE_UNTERMINATED && config.name == NULL;
+
+    printf(passed ? "Passed test 'decode'\n" : "Test 'decode' failed!\n");
+    return passed;
+}
+
+struct smh_dict test_scalar(const char *text){
+    return (struct smh_dict){ .kind = SMH_DICT_STRING, .as_string = { (char*) text, strlen(text) } };
+}
+
+bool test_int(const char *text, int64_t expected){
+    int64_t value;
+    struct smh_dict dict = test_scalar(text);
+    return smh_dict_int(&dict, &value) && value == expected;
+}
+
+bool test_float(const char *text, double expected){
+    double value;
+    struct smh_dict dict = test_scalar(text);
+    return smh_dict_float(&dict, &value) && value == expected;
+}
+
+bool test_duration(const char *text, double expected){
+    double value;
+    struct smh_dict dict = test_scalar(text);
+    return smh_dict_duration(&dict, &value) && value == expected;
+}
+
+bool test_size(const char *text, uint64_t expected){
+    uint64_t value;
+    struct smh_dict dict = test_scalar(text);
+    return smh_dict_size(&dict, &value) && value == expected;
+}
+
+bool test_refused(const char *text, enum smh_scalar_kind kind){
+    union smh_scalar value;
+    struct smh_dict dict = test_scalar(text);
+    return !smh_dict_scalar(&dict, kind, &value) && dict.cached == SMH_SCALAR_NONE;
+}
+
+// Strings read as numbers, booleans, durations and sizes, one at a time or a column at a time
+bool test_scalars(){
+    bool passed = test_int("100", 100) && test_int("-42", -42) && test_int("+7", 7);
+    passed = passed && test_int("9223372036854775807", INT64_MAX) && test_int("-9223372036854775808", INT64_MIN);
+    passed = passed && test_refused("9223372036854775808", SMH_SCALAR_INT) && test_refused("12a", SMH_SCALAR_INT);
+    passed = passed && test_refused("", SMH_SCALAR_INT) && test_refused("-", SMH_SCALAR_INT) && test_refused(" 1", SMH_SCALAR_INT);
+
+    // Floats round correctly whether or not they take the fast path
+    passed = passed && test_float("0.1", 0.1) && test_float("-2.5e-3", -2.5e-3) && test_float(".5", 0.5) && test_float("7.", 7.0);
+    passed = passed && test_float("3.14159265358979323846264338327950288", 3.141592653589793);
+    passed = passed && test_float("1e308", 1e308) && test_float("4.9e-324", 4.9e-324) && test_float("1e-400", 0.0);
+    passed = passed && test_float("123456789012345678901234567890", 123456789012345678901234567890.0);
+    passed = passed && test_float("0.000000000000000000000000000001", 1e-30) && test_float("0", 0.0);
+    passed = passed && test_refused("1e309", SMH_SCALAR_FLOAT) && test_refused("1,5", SMH_SCALAR_FLOAT);
+    passed = passed && test_refused(".", SMH_SCALAR_FLOAT) && test_refused("1e", SMH_SCALAR_FLOAT) && test_refused("inf", SMH_SCALAR_FLOAT);
+
+    bool flag;
+    struct smh_dict yes = test_scalar("yes");
+    passed = passed && smh_dict_bool(&yes, &flag) && flag && test_refused("True", SMH_SCALAR_BOOL);
+
+    passed = passed && test_duration("1.5s", 1.5) && test_duration("250ms", 0.25) && test_duration("1h30m", 5400);
+    passed = passed && test_duration("0", 0) && test_duration("-2d", -172800);
+    passed = passed && test_refused("10", SMH_SCALAR_DURATION) && test_refused("5 s", SMH_SCALAR_DURATION) && test_refused("3w", SMH_SCALAR_DURATION);
+
+    passed = passed && test_size("512", 512) && test_size("64K", 65536) && test_size("8MiB", 8388608) && test_size("1GB", 1073741824);
+    passed = passed && test_size("16777215T", (uint64_t) 16777215 << 40) && test_refused("16777216T", SMH_SCALAR_SIZE);
+    passed = passed && test_size("10k", 10240) && test_size("10m", 10485760) && test_size("2g", 2147483648) && test_size("1tiB", (uint64_t) 1 << 40);
+    passed = passed && test_refused("1.5G", SMH_SCALAR_SIZE) && test_refused("8Mb", SMH_SCALAR_SIZE);
+
+    // Kinds that aren't scalars never read, even from the cache
+    passed = passed && test_refused("1", SMH_SCALAR_NONE) && test_refused("1", (enum smh_scalar_kind) 99);
+
+    union smh_scalar stale;
+    struct smh_dict tagged = test_scalar("1");
+    tagged.cached = (enum smh_scalar_kind) 99;
+    passed = passed && !smh_dict_scalar(&tagged, (enum smh_scalar_kind) 99, &stale);
+
+    const char *markup = "- name: Isaac\n  age: 100\n  height: 1.8\n- age: 42\n  name: Joe\n  height: 1.65\n- name: Ann\n  age: unknown\n";
+    struct smh_result result = smh_parse(markup);
+    passed = passed && result.ok;
+
+    if(result.ok){
+        struct smh_array *people = &result.as_success.as_array;
+        struct smh_key age = smh_key("age", 3);
+        struct smh_key height = smh_key("height", 6);
+        int64_t ages[3];
+        double heights[3];
+
+        // Columns stop at the first item that can't be read
+        passed = passed && smh_array_ints(people, &age, ages) == 2 && ages[0] == 100 && ages[1] == 42;
+        passed = passed && smh_array_floats(people, &height, heights) == 2 && heights[1] == 1.65;
+        passed = passed && smh_array_ints(people, NULL, ages) == 0;
+
+        // Cached values are kept in the dict and read back by the plain readers
+        struct smh_dict *first = smh_object_get(&people->items[0].as_object, "age", 3);
+        union smh_scalar value;
+        int64_t cached;
+
+        passed = passed && smh_dict_scalar(first, SMH_SCALAR_INT, &value) && value.as_int == 100 && first->cached == SMH_SCALAR_INT;
+        first->as_string.cstr[0] = '2';
+        passed = passed && smh_dict_int(first, &cached) && cached == 100 && smh_dict_scalar(first, SMH_SCALAR_FLOAT, &value) && value.as_float == 200.0;
+        passed = passed && first->cached == SMH_SCALAR_FLOAT && strcmp(first->as_string.cstr, "200") == 0;
+
+        smh_result_free(&result);
+    }
+
+    printf(passed ? "Passed test 'scalars'\n" : "Test 'scalars' failed!\n");
+    return passed;
+}
+
+#ifdef SMH_PARSER_COUNT_ALLOCATIONS
+// Counts what a parse allocates, and that freeing the document gives all of it back
+bool test_allocations(){
+    const char *markup = "- name: Isaac\n  tags: [a, b]\n- name: Joe\n";
+    struct smh_allocations parsing;
+    struct smh_result result = smh_parse_ex(markup, &(struct smh_options){ .allocations = &parsing });
+    bool passed = result.ok && parsing.allocations > 0 && parsing.bytes >= parsing.peak && parsing.peak >= parsing.current && parsing.current > 0;
+
+    struct smh_allocations freeing = {0};
+    smh_count_allocations(&freeing);
+    smh_result_free(&result);
+    smh_count_allocations(NULL);
+    passed = passed && freeing.allocations == 0 && freeing.frees > 0 && freeing.current == 0;
+
+    // Nothing is counted once counting stops
+    struct smh_result uncounted = smh_parse(markup);
+    smh_result_free(&uncounted);
+    passed = passed && freeing.allocations == 0;
+
+    struct smh_allocations validating = {0};
+    smh_count_allocations(&validating);
+    passed = passed && smh_validate(markup, strlen(markup)) == SMH_ERRORCODE_NONE;
+    smh_count_allocations(NULL);
+    passed = passed && validating.allocations == 0;
+
+    printf(passed ? "Passed test 'allocations'\n" : "Test 'allocations' failed!\n");
+    return passed;
+}
+#endif
+
+#ifdef SMH_PARSER_STATS
+struct test_trace {
+    size_t begun;
+    size_t length;
+    enum smh_errorcode errorcode;
+    size_t strings;
+};
+
+void test_trace_begin(void *user, const char *data, size_t length){
+    struct test_trace *trace = user;
+    (void) data;
+    trace->begun++;
+    trace->length = length;
+}
+
+void test_trace_end(void *user, enum smh_errorcode errorcode, const struct smh_stats *stats){
+    struct test_trace *trace = user;
+    trace->errorcode = errorcode;
+    trace->strings = stats->nodes[SMH_DICT_STRING];
+}
+
+// Statistics describe the document and the work of parsing it, and hooks see every parse
+bool test_stats(){
+    const char *markup = "- name: Isaac\n  tags: [a, b]\n- name: Joe\n";
+    struct smh_stats stats;
+    struct smh_result result = smh_parse_ex(markup, &(struct smh_options){ .stats = &stats });
+    bool passed = result.ok;
+    smh_result_free(&result);
+
+    passed = passed && stats.nodes[SMH_DICT_ARRAY] == 2 && stats.nodes[SMH_DICT_OBJECT] == 2 && stats.nodes[SMH_DICT_STRING] == 4;
+    passed = passed && stats.max_depth == 3 && stats.bytes_copied == 22;
+    passed = passed && stats.rewinds > 0 && stats.bytes_scanned > strlen(markup);
+
+    // Borrowed strings aren't copied
+    result = smh_parse_ex(markup, &(struct smh_options){ .stats = &stats, .borrow_strings = true });
+    smh_result_free(&result);
+    passed = passed && stats.bytes_copied == 0 && stats.nodes[SMH_DICT_STRING] == 4;
+
+    struct test_trace trace = {0};
+    struct smh_trace hooks = { &trace, test_trace_begin, test_trace_end };
+
+    result = smh_parse_ex(markup, &(struct smh_options){ .trace = &hooks });
+    smh_result_free(&result);
+    passed = passed && trace.begun == 1 && trace.length == strlen(markup) && trace.errorcode == SMH_ERRORCODE_NONE && trace.strings == 4;
+
+    result = smh_parse_ex("[a, b", &(struct smh_options){ .trace = &hooks });
+    passed = passed && !result.ok && trace.begun == 2 && trace.errorcode == SMH_ERRORCODE_UNTERMINATED;
+
+    printf(passed ? "Passed test 'stats'\n" : "Test 'stats' failed!\n");
+    return passed;
+}
+#endif
+
+int main(){
+    smh_arena_create(&arena, 256);
+    symbols = smh_symbols_create();
+
+    for(int mode = 0; mode < TEST_MODE_COUNT; mode++){
+        for(struct test_case *test = tests; test->input; test++){
+            char *json = test_json(test->input, test->expected, mode);
+            bool failed = strcmp(json, test->expected) != 0;
+
+            if(failed){
+                printf("Test '%s' (%s) failed!\n", test->name, test_mode_names[mode]);
+                printf("------ Expected: ------\n%s\n", test->expected);
+                printf("------- Actual: -------\n%s\n", json);
+                free(json);
+                return 1;
+            }
+
+            free(json);
+
+            printf("Passed test '%s' (%s)\n", test->name, test_mode_names[mode]);
+        }
+    }
+
+    smh_arena_free(&arena);
+    smh_symbols_free(symbols);
+
+    if(!test_object_get()) return 1;
+    if(!test_queries()) return 1;
+    if(!test_depth_limit()) return 1;
+    if(!test_json_formats()) return 1;
+    if(!test_emit()) return 1;
+    if(!test_snapshot()) return 1;
+    if(!test_document()) return 1;
+    if(!test_symbols()) return 1;
+
+#if defined(__linux__)
+    if(!test_file_stream()) return 1;
+#endif
+    if(!test_decode()) return 1;
+    if(!test_scalars()) return 1;
+
+#ifdef SMH_PARSER_CACHE
+    if(!test_cache()) return 1;
+#endif
+
+#ifdef SMH_PARSER_COUNT_ALLOCATIONS
+    if(!test_allocations()) return 1;
+#endif
+
+#ifdef SMH_PARSER_STATS
+    if(!test_stats()) return 1;
+#endif
+
     printf("All tests passed!\n");
     return 0;
 }